@@ -0,0 +1,115 @@
+// Measures how long the HTTP server takes to receive and decode
+// "Transfer-Encoding: chunked" request bodies made of many small chunks.
+//
+// With "delete" as the last argument the server streams the body instead,
+// calling mg_http_delete_chunk() for every chunk it sees.
+//
+// Usage: bench-chunked [num_chunks] [chunk_size] [num_requests] [port] [delete]
+
+#include "mongoose.h"
+
+struct bench {
+  struct mg_str request;     // Complete request, sent as one blob
+  size_t body_len;           // Expected decoded body length
+  int num_requests;          // Requests to send
+  int sent, received;        // Progress
+  unsigned long chunk_events;  // MG_EV_HTTP_CHUNK events seen by server
+  bool delete_chunks;         // Server drops chunks as they arrive
+  bool failed;
+};
+
+static void server_fn(struct mg_connection *c, int ev, void *ev_data,
+                      void *fn_data) {
+  struct bench *b = (struct bench *) fn_data;
+  if (ev == MG_EV_HTTP_CHUNK) {
+    b->chunk_events++;
+    struct mg_http_message *hm = (struct mg_http_message *) ev_data;
+    if (b->delete_chunks) mg_http_delete_chunk(c, hm);
+  } else if (ev == MG_EV_HTTP_MSG) {
+    struct mg_http_message *hm = (struct mg_http_message *) ev_data;
+    if (hm->body.len != b->body_len) b->failed = true;
+    mg_http_reply(c, 200, "", "%s", "ok");
+  }
+}
+
+static void client_fn(struct mg_connection *c, int ev, void *ev_data,
+                      void *fn_data) {
+  struct bench *b = (struct bench *) fn_data;
+  if (ev == MG_EV_CONNECT) {
+    mg_send(c, b->request.ptr, b->request.len);
+    b->sent++;
+  } else if (ev == MG_EV_READ) {
+    struct mg_http_message hm;
+    int n;
+    while ((n = mg_http_parse((char *) c->recv.buf, c->recv.len, &hm)) > 0 &&
+           c->recv.len >= hm.message.len) {
+      mg_iobuf_del(&c->recv, 0, hm.message.len);
+      b->received++;
+      if (b->sent < b->num_requests) {
+        mg_send(c, b->request.ptr, b->request.len);
+        b->sent++;
+      }
+    }
+  } else if (ev == MG_EV_ERROR) {
+    b->failed = true;
+  }
+  (void) ev_data;
+}
+
+static struct mg_str build_request(size_t num_chunks, size_t chunk_size) {
+  const char *head =
+      "POST /upload HTTP/1.1\r\n"
+      "Host: localhost\r\n"
+      "Transfer-Encoding: chunked\r\n\r\n";
+  size_t i, cap = strlen(head) + num_chunks * (chunk_size + 24) + 8, len = 0;
+  char *buf = (char *) malloc(cap);
+  len += (size_t) mg_snprintf(buf + len, cap - len, "%s", head);
+  for (i = 0; i < num_chunks; i++) {
+    len += (size_t) mg_snprintf(buf + len, cap - len, "%lx\r\n",
+                                (unsigned long) chunk_size);
+    memset(buf + len, 'a' + (int) (i % 26), chunk_size);
+    len += chunk_size;
+    memcpy(buf + len, "\r\n", 2);
+    len += 2;
+  }
+  memcpy(buf + len, "0\r\n\r\n", 5);
+  len += 5;
+  return mg_str_n(buf, len);
+}
+
+int main(int argc, char *argv[]) {
+  size_t num_chunks = argc > 1 ? (size_t) atoi(argv[1]) : 1000;
+  size_t chunk_size = argc > 2 ? (size_t) atoi(argv[2]) : 32;
+  int port = argc > 4 ? atoi(argv[4]) : 8765;
+  struct bench b;
+  struct mg_mgr mgr;
+  char url[64];
+  uint64_t start, elapsed;
+
+  memset(&b, 0, sizeof(b));
+  b.num_requests = argc > 3 ? atoi(argv[3]) : 100;
+  b.delete_chunks = argc > 5 && strcmp(argv[5], "delete") == 0;
+  b.body_len = b.delete_chunks ? 0 : num_chunks * chunk_size;
+  b.request = build_request(num_chunks, chunk_size);
+
+  mg_log_set("0");
+  mg_mgr_init(&mgr);
+  mg_snprintf(url, sizeof(url), "http://127.0.0.1:%d", port);
+  if (mg_http_listen(&mgr, url, server_fn, &b) == NULL) return EXIT_FAILURE;
+  start = mg_millis();
+  mg_connect(&mgr, url, client_fn, &b);
+  while (b.received < b.num_requests && !b.failed) mg_mgr_poll(&mgr, 50);
+  elapsed = mg_millis() - start;
+
+  printf("%d requests, %lu chunks x %lu bytes (%lu byte requests): %lu ms, "
+         "%.1f us/request, %lu chunk events%s%s\n",
+         b.received, (unsigned long) num_chunks, (unsigned long) chunk_size,
+         (unsigned long) b.request.len, (unsigned long) elapsed,
+         b.received ? (double) elapsed * 1000.0 / b.received : 0.0,
+         b.chunk_events, b.delete_chunks ? ", deleting chunks" : "",
+         b.failed ? " (FAILED)" : "");
+
+  mg_mgr_free(&mgr);
+  free((char *) b.request.ptr);
+  return b.failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
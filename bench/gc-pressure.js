@@ -0,0 +1,127 @@
+// Measures what each HTTP request costs the JavaScript heap: allocator
+// calls and bytes per request, with the peak and the live heap left at the
+// end, which together drive how often and how long the garbage collector
+// runs.
+//
+// "current" serves the requests through js/mongoose.js. "legacy" serves
+// them like the bindings used to: every request wrapped in objects made of
+// per-request closures, and the native message state allocated for each
+// event (messagePoolSize = 0).
+//
+// Usage: bench-js ../bench/gc-pressure.js [current|legacy] [requests] [connections] [port]
+
+import * as std from "std";
+import { setInterval, clearInterval } from "../js/utils.js";
+import { match } from "../js/pathToRegEx.js";
+import * as bench from "bench";
+
+const [mode = "current", requests = "5000", connections = "32", port = "8780"] = scriptArgs.slice(1);
+const PATH = "/bench/:name";
+
+// The wrappers js/mongoose.js built for every request before they became
+// classes, reduced to their shape: one object and one closure per member
+function legacyRequest(msg) {
+    return {
+        get uri() { return msg.uri },
+        get method() { return msg.method },
+        get query() { return msg.query },
+        get body() { return msg.body },
+        get headers() { return msg.headers },
+        get queryParams() { return msg.queryParams },
+        getQueryParam: (name) => msg.getQueryParam(name),
+        getHeader: (name) => msg.getHeaderValue(name),
+        getJson: () => JSON.parse(msg.body)
+    };
+}
+
+function legacyResponse(msg) {
+    let headers = null;
+    const res = { status: 200, headersSent: false, compress: true };
+    const applyCacheRules = (rules) => rules;
+    return {
+        get headersSent() { return res.headersSent },
+        setHeader(name, val) {
+            if (headers === null) headers = msg.responseHeaders;
+            headers.set(name, String(val));
+            return this;
+        },
+        status(statusCode) { res.status = statusCode; return this },
+        compress(enabled) { res.compress = enabled; return this },
+        send(body) {
+            msg.httpReply(res.status, headers, body, res.compress);
+            res.headersSent = true;
+        },
+        write: (body) => msg.httpWrite(body),
+        stream: async (source) => source,
+        sseSubscribe: (group) => msg.sseSubscribe(group, headers, null),
+        sendJson(json) { return this.send(JSON.stringify(json)) },
+        cacheFor(ttlMs) { return this },
+        cacheControl(policy) { return this },
+        sendConditional: (validators, buildBody) => buildBody(),
+        serveDir: (dir) => applyCacheRules(dir),
+        serveFile: (file) => applyCacheRules(file),
+        wsUpgrade: (label) => label
+    };
+}
+
+function legacyServer() {
+    return import("../build/libqjsMongoose.so").then(({ MongooseManager }) => {
+        const srv = new MongooseManager();
+        const matchUrl = match(PATH, { decode: decodeURIComponent });
+        const handlers = [{
+            matchFn: (req) => req.method === "GET" && matchUrl(req.uri),
+            callback: (req, res, params) => res.sendJson({ hello: params.name })
+        }];
+        srv.messagePoolSize = 0;
+        srv.onHttpMessage = (msg) => {
+            const req = legacyRequest(msg);
+            const res = legacyResponse(msg);
+            let shouldStop = false;
+            const next = () => shouldStop = false;
+            for (const h of handlers) {
+                const m = h.matchFn(req);
+                if (m) {
+                    shouldStop = true;
+                    h.callback(req, res, m.params, next);
+                    if (shouldStop) return;
+                }
+            }
+        };
+        srv.httpListen(`http://127.0.0.1:${port}`);
+        setInterval(() => srv.poll(10), 50);
+    });
+}
+
+function currentServer() {
+    return import("../js/mongoose.js").then(({ default: mongoose }) => {
+        mongoose.httpGet(PATH, (req, res, params) => res.sendJson({ hello: params.name }));
+        mongoose.httpListen(`http://127.0.0.1:${port}`);
+    });
+}
+
+function run() {
+    bench.gc();
+    const before = bench.allocStats();
+    bench.httpLoad(Number(port), "/bench/world", Number(requests), Number(connections));
+    const timer = setInterval(() => {
+        const status = bench.loadStatus();
+        if (!status.done) return;
+        clearInterval(timer);
+        const after = bench.allocStats();
+        bench.gc();
+        const live = bench.allocStats().live;
+        const n = status.completed;
+        console.log(`${mode}: ${n} requests over ${connections} connections in ${status.ms} ms` +
+            `${status.failed ? `, ${status.failed} failed` : ""}`);
+        console.log(`  ${((after.allocs - before.allocs) / n).toFixed(1)} allocations/request, ` +
+            `${((after.bytes - before.bytes) / n).toFixed(0)} bytes/request`);
+        console.log(`  peak heap ${(after.peak / 1024).toFixed(0)} KiB, ` +
+            `live after GC ${(live / 1024).toFixed(0)} KiB`);
+        std.exit(status.failed ? 1 : 0);
+    }, 100);
+}
+
+(mode === "legacy" ? legacyServer() : currentServer()).then(run, (e) => {
+    console.log(e);
+    std.exit(1);
+});
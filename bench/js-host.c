@@ -0,0 +1,409 @@
+// Minimal QuickJS host for the JavaScript benchmarks in bench/: runs a
+// module with the std and os modules, like qjs, plus a "bench" module
+// offering native HTTP and WebSocket load generators, allocator statistics
+// and the CPU time of the script's thread.
+//
+// The runtime allocates through counting functions, so that scripts can
+// measure how much memory each request costs and thus how much work they
+// leave to the garbage collector. The load generator runs in its own
+// thread with its own mongoose manager, to keep the measured runtime free
+// of client work.
+//
+// Usage: bench-js SCRIPT [ARG...]
+//
+// The library is loaded by js/mongoose.js from build/libqjsMongoose.so.
+
+#include <malloc.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <quickjs/quickjs.h>
+#include <quickjs/quickjs-libc.h>
+
+#include "mongoose.h"
+
+struct alloc_stats {
+  uint64_t allocs;      // malloc(), calloc() and growing realloc() calls
+  uint64_t bytes;       // Bytes they asked for
+  int64_t live;         // Bytes currently allocated
+  int64_t peak;
+};
+
+static struct alloc_stats s_stats;
+
+static void count_alloc(void *ptr, size_t size) {
+  int64_t n = (int64_t) malloc_usable_size(ptr);
+  s_stats.allocs++;
+  s_stats.bytes += size;
+  s_stats.live += n;
+  if (s_stats.live > s_stats.peak) s_stats.peak = s_stats.live;
+}
+
+static void *bench_calloc(void *opaque, size_t count, size_t size) {
+  void *ptr = calloc(count, size);
+  if (ptr != NULL) count_alloc(ptr, count * size);
+  (void) opaque;
+  return ptr;
+}
+
+static void *bench_malloc(void *opaque, size_t size) {
+  void *ptr = malloc(size);
+  if (ptr != NULL) count_alloc(ptr, size);
+  (void) opaque;
+  return ptr;
+}
+
+static void bench_free(void *opaque, void *ptr) {
+  if (ptr != NULL) s_stats.live -= (int64_t) malloc_usable_size(ptr);
+  free(ptr);
+  (void) opaque;
+}
+
+static void *bench_realloc(void *opaque, void *ptr, size_t size) {
+  size_t old = ptr == NULL ? 0 : malloc_usable_size(ptr);
+  void *res;
+  if (size == 0) {
+    bench_free(opaque, ptr);
+    return NULL;
+  }
+  if ((res = realloc(ptr, size)) == NULL) return NULL;
+  s_stats.live -= (int64_t) old;
+  if (size > old) {
+    count_alloc(res, size - old);
+  } else {
+    s_stats.live += (int64_t) malloc_usable_size(res);
+  }
+  return res;
+}
+
+static size_t bench_usable_size(const void *ptr) {
+  return malloc_usable_size((void *) ptr);
+}
+
+static const JSMallocFunctions s_malloc_funcs = {
+    bench_calloc, bench_malloc, bench_free, bench_realloc, bench_usable_size,
+};
+
+// One load at a time, HTTP or WebSocket
+struct load {
+  char url[64];
+  char request[256];
+  int num_requests;         // HTTP
+  int num_connections;
+  int rate;                 // WebSocket frames per second
+  uint64_t duration;        // WebSocket, in milliseconds
+  int sent;
+  atomic_int completed;     // Responses, or echoed frames
+  atomic_int failed;
+  atomic_bool done;
+  uint64_t start, elapsed;  // mg_millis()
+  pthread_t thread;
+};
+
+static struct load s_load;
+
+// HTTP load: each connection sends its next request once the previous
+// response arrived, until the total is reached
+static void http_load_fn(struct mg_connection *c, int ev, void *ev_data,
+                         void *fn_data) {
+  struct load *l = (struct load *) fn_data;
+  if (ev == MG_EV_CONNECT) {
+    if (l->sent < l->num_requests) {
+      mg_printf(c, "%s", l->request);
+      l->sent++;
+    }
+  } else if (ev == MG_EV_READ) {
+    struct mg_http_message hm;
+    int n;
+    while ((n = mg_http_parse((char *) c->recv.buf, c->recv.len, &hm)) > 0 &&
+           c->recv.len >= hm.message.len) {
+      mg_iobuf_del(&c->recv, 0, hm.message.len);
+      atomic_fetch_add(&l->completed, 1);
+      if (l->sent < l->num_requests) {
+        mg_printf(c, "%s", l->request);
+        l->sent++;
+      }
+    }
+  } else if (ev == MG_EV_ERROR) {
+    atomic_fetch_add(&l->failed, 1);
+  }
+  (void) ev_data;
+}
+
+static void *http_load_thread(void *arg) {
+  struct load *l = (struct load *) arg;
+  struct mg_mgr mgr;
+  mg_mgr_init(&mgr);
+  l->start = mg_millis();
+  for (int i = 0; i < l->num_connections; i++) {
+    mg_connect(&mgr, l->url, http_load_fn, l);
+  }
+  while (atomic_load(&l->completed) < l->num_requests &&
+         atomic_load(&l->failed) < l->num_connections) {
+    mg_mgr_poll(&mgr, 10);
+  }
+  l->elapsed = mg_millis() - l->start;
+  mg_mgr_free(&mgr);
+  atomic_store(&l->done, true);
+  return NULL;
+}
+
+// WebSocket load: small text frames at a fixed rate over all connections,
+// which count the frames the server echoes
+#define WS_LOAD_FRAME "0123456789abcdef"
+#define WS_LOAD_GRACE_MS 2000  // For the last echoes
+
+static void ws_load_fn(struct mg_connection *c, int ev, void *ev_data,
+                       void *fn_data) {
+  struct load *l = (struct load *) fn_data;
+  if (ev == MG_EV_WS_OPEN) {
+    c->label[0] = 'W';
+  } else if (ev == MG_EV_WS_MSG) {
+    atomic_fetch_add(&l->completed, 1);
+  } else if (ev == MG_EV_ERROR) {
+    atomic_fetch_add(&l->failed, 1);
+  }
+  (void) ev_data;
+}
+
+static size_t ws_load_open(struct mg_mgr *mgr) {
+  size_t n = 0;
+  for (struct mg_connection *c = mgr->conns; c != NULL; c = c->next) {
+    if (c->label[0] == 'W' && !c->is_closing) n++;
+  }
+  return n;
+}
+
+// The i-th open connection
+static struct mg_connection *ws_load_conn(struct mg_mgr *mgr, size_t i) {
+  for (struct mg_connection *c = mgr->conns; c != NULL; c = c->next) {
+    if (c->label[0] == 'W' && !c->is_closing && i-- == 0) return c;
+  }
+  return NULL;
+}
+
+static void *ws_load_thread(void *arg) {
+  struct load *l = (struct load *) arg;
+  struct mg_mgr mgr;
+  uint64_t now, deadline;
+  int total = (int) ((uint64_t) l->rate * l->duration / 1000);
+  size_t turn = 0;
+  mg_mgr_init(&mgr);
+  for (int i = 0; i < l->num_connections; i++) {
+    mg_ws_connect(&mgr, l->url, ws_load_fn, l, NULL);
+  }
+  deadline = mg_millis() + WS_LOAD_GRACE_MS;
+  while (ws_load_open(&mgr) < (size_t) l->num_connections &&
+         atomic_load(&l->failed) == 0 && mg_millis() < deadline) {
+    mg_mgr_poll(&mgr, 1);
+  }
+  l->start = now = mg_millis();
+  // Frames due so far go out round-robin over the open connections
+  while (atomic_load(&l->failed) == 0 && l->sent < total) {
+    int due = (int) ((uint64_t) l->rate * (now - l->start) / 1000);
+    size_t open = ws_load_open(&mgr);
+    if (due > total) due = total;
+    while (l->sent < due && open > 0) {
+      struct mg_connection *c = ws_load_conn(&mgr, turn++ % open);
+      mg_ws_send(c, WS_LOAD_FRAME, sizeof(WS_LOAD_FRAME) - 1, WEBSOCKET_OP_TEXT);
+      l->sent++;
+    }
+    mg_mgr_poll(&mgr, 1);
+    now = mg_millis();
+  }
+  deadline = now + WS_LOAD_GRACE_MS;
+  while (atomic_load(&l->completed) < l->sent && mg_millis() < deadline) {
+    mg_mgr_poll(&mgr, 1);
+  }
+  l->elapsed = mg_millis() - l->start;
+  mg_mgr_free(&mgr);
+  atomic_store(&l->done, true);
+  return NULL;
+}
+
+static int start_load(JSContext *ctx, void *(*fn)(void *)) {
+  s_load.sent = 0;
+  atomic_store(&s_load.completed, 0);
+  atomic_store(&s_load.failed, 0);
+  atomic_store(&s_load.done, false);
+  if (pthread_create(&s_load.thread, NULL, fn, &s_load) != 0) {
+    s_load.num_connections = 0;
+    JS_ThrowInternalError(ctx, "cannot start the load thread");
+    return -1;
+  }
+  return 0;
+}
+
+// httpLoad(port, path, requests, connections)
+static JSValue js_http_load(JSContext *ctx, JSValueConst this_val, int argc,
+                            JSValueConst *argv) {
+  int port, requests, connections;
+  const char *path;
+  if (s_load.num_connections > 0) {
+    return JS_ThrowTypeError(ctx, "a load is already running");
+  }
+  if (JS_ToInt32(ctx, &port, argv[0]) != 0 ||
+      JS_ToInt32(ctx, &requests, argv[2]) != 0 ||
+      JS_ToInt32(ctx, &connections, argv[3]) != 0 ||
+      (path = JS_ToCString(ctx, argv[1])) == NULL) {
+    return JS_EXCEPTION;
+  }
+  mg_snprintf(s_load.url, sizeof(s_load.url), "http://127.0.0.1:%d", port);
+  mg_snprintf(s_load.request, sizeof(s_load.request),
+              "GET %s HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n", path);
+  JS_FreeCString(ctx, path);
+  s_load.num_requests = requests > 0 ? requests : 1;
+  s_load.num_connections = connections > 0 ? connections : 1;
+  if (start_load(ctx, http_load_thread) != 0) return JS_EXCEPTION;
+  (void) this_val;
+  (void) argc;
+  return JS_UNDEFINED;
+}
+
+// wsLoad(port, path, framesPerSecond, ms, connections)
+static JSValue js_ws_load(JSContext *ctx, JSValueConst this_val, int argc,
+                          JSValueConst *argv) {
+  int port, rate, ms, connections;
+  const char *path;
+  if (s_load.num_connections > 0) {
+    return JS_ThrowTypeError(ctx, "a load is already running");
+  }
+  if (JS_ToInt32(ctx, &port, argv[0]) != 0 ||
+      JS_ToInt32(ctx, &rate, argv[2]) != 0 ||
+      JS_ToInt32(ctx, &ms, argv[3]) != 0 ||
+      JS_ToInt32(ctx, &connections, argv[4]) != 0 ||
+      (path = JS_ToCString(ctx, argv[1])) == NULL) {
+    return JS_EXCEPTION;
+  }
+  mg_snprintf(s_load.url, sizeof(s_load.url), "ws://127.0.0.1:%d%s", port,
+              path);
+  JS_FreeCString(ctx, path);
+  s_load.rate = rate > 0 ? rate : 1;
+  s_load.duration = ms > 0 ? (uint64_t) ms : 1000;
+  s_load.num_connections = connections > 0 ? connections : 1;
+  if (start_load(ctx, ws_load_thread) != 0) return JS_EXCEPTION;
+  (void) this_val;
+  (void) argc;
+  return JS_UNDEFINED;
+}
+
+// { done, sent, completed, failed, ms }
+static JSValue js_load_status(JSContext *ctx, JSValueConst this_val, int argc,
+                              JSValueConst *argv) {
+  JSValue obj = JS_NewObject(ctx);
+  bool done = atomic_load(&s_load.done);
+  if (done && s_load.num_connections > 0) {
+    pthread_join(s_load.thread, NULL);
+    s_load.num_connections = 0;  // Another load may start
+  }
+  JS_SetPropertyStr(ctx, obj, "done", JS_NewBool(ctx, done));
+  JS_SetPropertyStr(ctx, obj, "sent",
+                    JS_NewInt32(ctx, done ? s_load.sent : 0));
+  JS_SetPropertyStr(ctx, obj, "completed",
+                    JS_NewInt32(ctx, atomic_load(&s_load.completed)));
+  JS_SetPropertyStr(ctx, obj, "failed",
+                    JS_NewInt32(ctx, atomic_load(&s_load.failed)));
+  JS_SetPropertyStr(ctx, obj, "ms",
+                    JS_NewInt64(ctx, (int64_t) (done ? s_load.elapsed : 0)));
+  (void) this_val, (void) argc, (void) argv;
+  return obj;
+}
+
+// { allocs, bytes, live, peak } since the runtime started
+static JSValue js_alloc_stats(JSContext *ctx, JSValueConst this_val, int argc,
+                              JSValueConst *argv) {
+  JSValue obj = JS_NewObject(ctx);
+  struct alloc_stats s = s_stats;  // Before the object properties count
+  JS_SetPropertyStr(ctx, obj, "allocs", JS_NewInt64(ctx, (int64_t) s.allocs));
+  JS_SetPropertyStr(ctx, obj, "bytes", JS_NewInt64(ctx, (int64_t) s.bytes));
+  JS_SetPropertyStr(ctx, obj, "live", JS_NewInt64(ctx, s.live));
+  JS_SetPropertyStr(ctx, obj, "peak", JS_NewInt64(ctx, s.peak));
+  (void) this_val, (void) argc, (void) argv;
+  return obj;
+}
+
+// Milliseconds of CPU used by the calling thread, where the script and
+// the library run
+static JSValue js_cpu_time(JSContext *ctx, JSValueConst this_val, int argc,
+                           JSValueConst *argv) {
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  (void) this_val, (void) argc, (void) argv;
+  return JS_NewFloat64(ctx, ts.tv_sec * 1e3 + ts.tv_nsec / 1e6);
+}
+
+static JSValue js_gc(JSContext *ctx, JSValueConst this_val, int argc,
+                     JSValueConst *argv) {
+  JS_RunGC(JS_GetRuntime(ctx));
+  (void) this_val, (void) argc, (void) argv;
+  return JS_UNDEFINED;
+}
+
+static const JSCFunctionListEntry s_bench_funcs[] = {
+    JS_CFUNC_DEF("httpLoad", 4, js_http_load),
+    JS_CFUNC_DEF("wsLoad", 5, js_ws_load),
+    JS_CFUNC_DEF("loadStatus", 0, js_load_status),
+    JS_CFUNC_DEF("allocStats", 0, js_alloc_stats),
+    JS_CFUNC_DEF("cpuTime", 0, js_cpu_time),
+    JS_CFUNC_DEF("gc", 0, js_gc),
+};
+
+#define NUM_BENCH_FUNCS \
+  ((int) (sizeof(s_bench_funcs) / sizeof(s_bench_funcs[0])))
+
+static int bench_init(JSContext *ctx, JSModuleDef *m) {
+  return JS_SetModuleExportList(ctx, m, s_bench_funcs, NUM_BENCH_FUNCS);
+}
+
+static int eval_module(JSContext *ctx, const char *path) {
+  size_t len;
+  uint8_t *buf = js_load_file(ctx, &len, path);
+  JSValue val;
+  if (buf == NULL) {
+    fprintf(stderr, "cannot read %s\n", path);
+    return -1;
+  }
+  val = JS_Eval(ctx, (const char *) buf, len, path,
+                JS_EVAL_TYPE_MODULE | JS_EVAL_FLAG_COMPILE_ONLY);
+  js_free(ctx, buf);
+  if (!JS_IsException(val)) {
+    js_module_set_import_meta(ctx, val, true, true);
+    val = JS_EvalFunction(ctx, val);
+  }
+  if (JS_IsException(val)) {
+    js_std_dump_error(ctx);
+    return -1;
+  }
+  JS_FreeValue(ctx, val);
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  JSRuntime *rt;
+  JSContext *ctx;
+  JSModuleDef *m;
+  int res;
+
+  if (argc < 2) {
+    fprintf(stderr, "Usage: %s SCRIPT [ARG...]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  mg_log_set("0");
+  rt = JS_NewRuntime2(&s_malloc_funcs, NULL);
+  js_std_init_handlers(rt);
+  JS_SetModuleLoaderFunc(rt, NULL, js_module_loader, NULL);
+  ctx = JS_NewContext(rt);
+  js_std_add_helpers(ctx, argc - 1, argv + 1);
+  js_init_module_std(ctx, "std");
+  js_init_module_os(ctx, "os");
+  m = JS_NewCModule(ctx, "bench", bench_init);
+  JS_AddModuleExportList(ctx, m, s_bench_funcs, NUM_BENCH_FUNCS);
+
+  res = eval_module(ctx, argv[1]);
+  if (res == 0) js_std_loop(ctx);
+
+  js_std_free_handlers(rt);
+  JS_FreeContext(ctx);
+  JS_FreeRuntime(rt);
+  return res == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
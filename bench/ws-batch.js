@@ -0,0 +1,67 @@
+// Messages per second a WebSocket echo server handles when offered 1k, 10k
+// and 50k small frames per second. "direct" enters JS once per event,
+// "batched" once per poll through onEventBatch. Also reports the CPU time
+// of the server thread per thousand messages, and how often native code
+// called into JS.
+//
+// Usage: bench-js ../bench/ws-batch.js [direct|batched] [seconds] [connections] [port]
+
+import * as std from "std";
+import * as bench from "bench";
+import { MongooseManager } from "../build/libqjsMongoose.so";
+
+const [mode = "batched", seconds = "3", connections = "16", port = "8781"] = scriptArgs.slice(1);
+const RATES = [1000, 10000, 50000];
+
+const srv = new MongooseManager();
+let received = 0, calls = 0;
+
+srv.onHttpMessage = (msg) => {
+    if (mode === "direct") calls++;
+    msg.wsUpgrade();
+};
+srv.onWsMessage = (msg) => {
+    if (mode === "direct") calls++;
+    received++;
+    msg.connection.wsSendText(msg.text);
+};
+srv.onHttpClose = () => {
+    if (mode === "direct") calls++;
+};
+
+// Same as the dispatcher of js/mongoose.js
+if (mode === "batched") {
+    srv.onEventBatch = (events, count) => {
+        calls++;
+        let error = null;
+        for (let i = 0; i < count; i += 2) {
+            try {
+                events[i](events[i + 1]);
+            } catch (e) {
+                if (error === null) error = e;
+            }
+        }
+        if (error !== null) throw error;
+    };
+}
+
+srv.httpListen(`http://127.0.0.1:${port}`);
+
+function run(rate) {
+    const start = { received, calls, cpu: bench.cpuTime() };
+    let status;
+    bench.wsLoad(Number(port), "/ws", rate, Number(seconds) * 1000, Number(connections));
+    while (!(status = bench.loadStatus()).done) srv.poll(1);
+    const n = received - start.received;
+    const cpu = bench.cpuTime() - start.cpu;
+    console.log(`  ${rate} frames/s offered: ${n}/${status.sent} received, ` +
+        `${status.completed} echoes back, ${(n * 1000 / status.ms).toFixed(0)} msgs/s, ` +
+        `${(cpu * 1000 / Math.max(n, 1)).toFixed(2)} ms CPU per 1k msgs, ` +
+        `${calls - start.calls} calls into JS`);
+    return status.failed === 0;
+}
+
+console.log(`${mode}: ${connections} connections, ${seconds} s per rate`);
+let ok = true;
+for (const rate of RATES) ok = run(rate) && ok;
+std.exit(ok ? 0 : 1);
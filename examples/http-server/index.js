@@ -1,4 +1,6 @@
 import mongoose from "../../js/mongoose.js";
+import { setTimeout } from "os";
+import { setInterval } from "../../js/utils.js";
 
 const $log = (msg) => console.log(`[${new Date().toISOString()}] ${msg}`)
 
@@ -8,6 +10,29 @@ mongoose.httpGet("/api/hello/:name", (req, res, params) => {
     })
 });
 
+// Async handlers reply whenever their promise settles, a rejection
+// becomes a 500
+const sleep = (ms) => new Promise((resolve) => setTimeout(resolve, ms));
+
+mongoose.httpGet("/api/slow", async (req, res) => {
+    await sleep(500);
+    res.sendJson({ uri: req.uri, waited: 500 });
+});
+
+// Streams a large response chunk by chunk, rows are only generated as
+// fast as the client reads them
+mongoose.httpGet("/api/report", (req, res) => {
+    async function* rows() {
+        yield "id,value\n";
+        for (let i = 0; i < 100000; i++) yield `${i},${Math.random()}\n`;
+    }
+    res.setHeader("Content-Type", "text/csv").stream(rows());
+});
+
+// Server push without WebSocket: every subscriber gets the time each second
+const clock = mongoose.sseHandler("/api/clock");
+setInterval(() => clock.broadcast({ now: Date.now() }, { event: "tick" }), 1000);
+
 const wsHandler = mongoose.websocketHandler("/websocket");
 
 function logNumOfWebSocketConnections() {
@@ -21,7 +46,7 @@ wsHandler.onOpen((httpReq, conn) => {
 });
 
 wsHandler.onMessage((req, res) => {
-    const msg = req.getMessageAsString();
+    const msg = req.text;
     $log(`Got ws message from #${req.connectionId}: ${msg}`);
     res.sendText(msg); // echo message back
 });
@@ -1,109 +1,281 @@
 import { MongooseManager } from '../build/libqjsMongoose.so';
 import { setInterval, clearInterval } from './utils.js';
-import { match } from './pathToRegEx.js';
+import { match, parse } from './pathToRegEx.js';
 
 const SNTP_UPDATE_INTERVAL = 3600 * 1000; // 1 hour
 
-function httpRequest(msg) {
-    let queryParams = null;
-    return {
-        get uri() { return msg.uri },
-        get method() { return msg.method },
-        get query() { return msg.query },
-        get body() { return msg.body },
-        get headers() { return msg.headers },
-        get queryParams() {
-            if (queryParams === null) {
-                const kvPairs = msg.query.split("&").filter(i => i.length > 0).map(i => {
-                    const [k, v] = i.split("=");
-                    return [k, decodeURIComponent(v)];
-                });
-                queryParams = Object.fromEntries(kvPairs);
+// Requests and responses are plain instances of these classes, their
+// methods live on the prototypes: wrapping a native message costs one
+// small object rather than a closure per accessor
+class HttpRequest {
+    constructor(msg) {
+        this.msg = msg;
+    }
+    get uri() { return this.msg.uri }
+    get method() { return this.msg.method }
+    get query() { return this.msg.query }
+    get body() { return this.msg.body }
+    get headers() { return this.msg.headers }
+    get queryParams() { return this.msg.queryParams }
+    getQueryParam(name) {
+        return this.msg.getQueryParam(name);
+    }
+    getHeader(name) {
+        return this.msg.getHeaderValue(name);
+    }
+    getJson() {
+        return JSON.parse(this.msg.body);
+    }
+}
+
+function serveOptions(opts) {
+    if (opts === null || typeof opts !== "object") return { mimeTypes: opts };
+    return opts;
+}
+
+// Cache-Control value of a policy such as { maxAge: 3600, immutable: true },
+// { noCache: true } or { noStore: true }. Strings are used as they are.
+function cacheControlValue(policy) {
+    if (typeof policy === "string") return policy;
+    if (policy.noStore) return "no-store";
+    const parts = [];
+    if (policy.private) parts.push("private");
+    else if (policy.public) parts.push("public");
+    if (policy.noCache) parts.push("no-cache");
+    if (policy.maxAge !== undefined) parts.push(`max-age=${policy.maxAge}`);
+    if (policy.immutable) parts.push("immutable");
+    return parts.join(", ");
+}
+
+// "*" matches within a path segment and "**" across segments. Patterns
+// without a "/", like "*.js", are matched against the file name only.
+function globToRegExp(glob) {
+    const re = glob
+        .replace(/[.+^${}()|[\]\\]/g, "\\$&")
+        .replace(/\*\*|\*|\?/g, (m) => m === "**" ? ".*" : m === "*" ? "[^/]*" : "[^/]");
+    return new RegExp(glob.includes("/") ? `^${re}$` : `(^|/)${re}$`);
+}
+
+const compiledCacheRules = new WeakMap();
+
+// Rules are { path, ...policy } objects, the first matching one applies
+function cacheControlFor(rules, uri) {
+    let compiled = compiledCacheRules.get(rules);
+    if (!compiled) {
+        compiled = rules.map((rule) => ({
+            test: rule.path instanceof RegExp ? rule.path : globToRegExp(rule.path),
+            value: cacheControlValue(rule)
+        }));
+        compiledCacheRules.set(rules, compiled);
+    }
+    for (const rule of compiled) {
+        if (rule.test.test(uri)) return rule.value;
+    }
+    return null;
+}
+
+const DEFAULT_STREAM_WATERMARK = 64 * 1024;
+
+// Async iterables and iterables are used as they are, ReadableStream-like
+// sources through their reader
+function toAsyncIterable(source) {
+    if (source[Symbol.asyncIterator] || source[Symbol.iterator]) return source;
+    if (typeof source.getReader === "function") {
+        return {
+            async *[Symbol.asyncIterator]() {
+                const reader = source.getReader();
+                try {
+                    for (;;) {
+                        const { done, value } = await reader.read();
+                        if (done) return;
+                        yield value;
+                    }
+                } finally {
+                    if (reader.releaseLock) reader.releaseLock();
+                }
             }
-            return queryParams;
-        },
-        getQueryParam(name) {
-            return this.queryParams[name];
-        },
-        getHeader(name) {
-            return msg.getHeaderValue(name);
-        },
-        getJson() {
-            return JSON.parse(msg.body);
-        }
+        };
     }
+    throw new TypeError("stream source is not iterable");
 }
 
-function httpResponse(msg) {
-    const res = { 
-        headers: {}, 
-        status: 200, 
-        headersSent: false,
-        get headersText() {
-            return Object.entries(this.headers)
-                .map(([name, val]) => `${name}: ${val}\r\n`)
-                .join("");
+function isEmptyChunk(chunk) {
+    return chunk === undefined || chunk === null ||
+        (chunk.byteLength ?? String(chunk).length) === 0;
+}
+
+// waitDrain(msg, watermark) resolves to false if the connection closes
+class HttpResponse {
+    constructor(msg, waitDrain) {
+        this.msg = msg;
+        this.waitDrain = waitDrain;
+        // Native MongooseResponseHeaders, only created once a header is set
+        this.headers = null;
+        this.statusCode = 200;
+        this.headersSent = false;
+        this.compressEnabled = true;
+    }
+
+    // Handlers may set their own Cache-Control, rules do not override it
+    applyCacheRules(rules) {
+        if (rules === null || (this.headers !== null && this.headers.has("Cache-Control"))) return;
+        const value = cacheControlFor(rules, this.msg.uri);
+        if (value !== null) this.setHeader("Cache-Control", value);
+    }
+
+    writeHead() {
+        if (!this.headersSent) {
+            this.msg.httpWriteHead(this.statusCode, this.headers, this.compressEnabled);
+            this.headersSent = true;
         }
-    };
+    }
 
-    return {
-        setHeader(name, val) {
-            res.headers[name] = val;
-            return this;
-        },
-        status(statusCode) {
-            res.status = statusCode;
-            return this;
-        },
-        send(body) {
-            msg.httpReply(res.status, res.headersText, body);
-            res.headersSent = true;
-        },
-        write(body) {
-            if (!res.headersSent) this.send("");
-            msg.httpWrite(body);
-        },
-        sendJson(json) {
-            return this.setHeader("Content-Type", "application/json").send(JSON.stringify(json));
-        },
-        serveDir(dir, mimeTypes = null) {
-            msg.httpServeDir(dir, res.headersText, mimeTypes)
-        },
-        serveFile(file, mimeTypes = null) {
-            msg.httpServeFile(file, res.headersText, mimeTypes)
-        },
-        wsUpgrade(label) {
-            msg.connection.label = label;
-            msg.wsUpgrade();
-            return wsResponse(msg.connection);
+    setHeader(name, val) {
+        if (this.headers === null) this.headers = this.msg.responseHeaders;
+        this.headers.set(name, String(val));
+        return this;
+    }
+    status(statusCode) {
+        this.statusCode = statusCode;
+        return this;
+    }
+    compress(enabled) {
+        this.compressEnabled = enabled;
+        return this;
+    }
+    send(body) {
+        this.msg.httpReply(this.statusCode, this.headers, body, this.compressEnabled);
+        this.headersSent = true;
+    }
+    write(body) {
+        this.writeHead();
+        this.msg.httpWrite(body);
+    }
+    // Sends the chunks of source as a chunked response. The next chunk
+    // is only pulled once no more than watermark bytes wait to be sent,
+    // so memory stays bounded whatever the size of the body. Resolves
+    // to false if the client went away before the end.
+    async stream(source, { watermark = DEFAULT_STREAM_WATERMARK } = {}) {
+        const msg = this.msg;
+        const chunks = toAsyncIterable(source);
+        this.writeHead();
+        try {
+            for await (const chunk of chunks) {
+                // An empty chunk would end the response
+                if (isEmptyChunk(chunk)) continue;
+                if (!msg.httpWrite(chunk)) return false;
+                if (msg.sendBuffered > watermark && !(await this.waitDrain(msg, watermark)))
+                    return false;
+            }
+        } catch (e) {
+            msg.httpAbort();
+            throw e;
         }
+        return msg.httpWrite("");
+    }
+    // Turns the response into an event stream of an SSE group
+    sseSubscribe(group, retryMs = null) {
+        this.msg.sseSubscribe(group, this.headers, retryMs);
+        this.headersSent = true;
+    }
+    sendJson(json) {
+        return this.setHeader("Content-Type", "application/json").send(JSON.stringify(json));
+    }
+    // Keeps the reply sent with send() in the native response cache,
+    // see setResponseCache(). Later identical GET requests are answered
+    // without running any handler, so nothing in the response may
+    // depend on request headers other than those listed in vary.
+    cacheFor(ttlMs, { staleWhileRevalidateMs = 0, vary = [] } = {}) {
+        this.msg.cacheResponse(ttlMs, staleWhileRevalidateMs, vary.join(","));
+        return this;
+    }
+    cacheControl(policy) {
+        return this.setHeader("Cache-Control", cacheControlValue(policy));
+    }
+    // Replies 304 when the client's copy matches the given validators,
+    // buildBody() only runs when a full response is needed
+    sendConditional({ etag = null, lastModified = null }, buildBody) {
+        if (etag !== null) this.setHeader("ETag", etag);
+        if (lastModified !== null)
+            this.setHeader("Last-Modified", new Date(lastModified).toUTCString());
+        if (this.msg.isFresh(etag, lastModified === null ? null : new Date(lastModified).getTime())) {
+            this.msg.httpReply(304, this.headers, "", false);
+            this.headersSent = true;
+            return;
+        }
+        this.send(buildBody());
+    }
+    // opts is either the mime types string or { mimeTypes, fs, cache },
+    // where fs is 'posix' (default) or 'packed' for the files built into
+    // the library, and cache a list of Cache-Control rules by path
+    serveDir(dir, opts = null) {
+        const { mimeTypes = null, fs = null, cache = null } = serveOptions(opts);
+        this.applyCacheRules(cache);
+        this.msg.httpServeDir(dir, this.headers, mimeTypes, fs);
+        this.headersSent = true;
+    }
+    serveFile(file, opts = null) {
+        const { mimeTypes = null, fs = null, cache = null } = serveOptions(opts);
+        this.applyCacheRules(cache);
+        this.msg.httpServeFile(file, this.headers, mimeTypes, fs);
+        this.headersSent = true;
+    }
+    // The label is free for the application, connections are told apart
+    // by their numeric id
+    wsUpgrade(label = null) {
+        const conn = this.msg.connection;
+        if (label !== null) conn.label = label;
+        this.msg.wsUpgrade();
+        this.headersSent = true;
+        return new WsResponse(conn);
     }
 }
 
-function wsRequest(conn, msg) {
-    return {
-        get connectionId() { 
-            return conn.label; 
-        },
-        get message() {
-            return msg.message;
-        },
-        getMessageAsString() {
-            return String.fromCharCode.apply(null, new Uint8Array(msg.message));
-        },
-        getMessageAsJson() {
-            return JSON.parse(getMessageAsString());
-        }
+class WsRequest {
+    constructor(conn, msg) {
+        this.conn = conn;
+        this.msg = msg;
+    }
+    get connectionId() {
+        return this.conn.id;
+    }
+    // A view on the receive buffer, empty once the handler returned
+    get message() {
+        return this.msg.message;
+    }
+    get text() {
+        return this.msg.text;
+    }
+    get isText() {
+        return this.msg.isText;
+    }
+    // For messages kept after the handler returned
+    copy() {
+        return this.msg.copy();
+    }
+    getMessageAsString() {
+        return this.msg.text;
+    }
+    getMessageAsJson() {
+        return JSON.parse(this.msg.text);
     }
 }
 
-function wsResponse(conn) {
-    return {
-        get connectionId() { 
-            return conn.label; 
-        },
-        sendText: (data) => conn.wsSendText(data),
-        sendBinary: (data) => conn.wsSendBinary(data)
+class WsResponse {
+    constructor(conn) {
+        this.conn = conn;
+    }
+    get connectionId() {
+        return this.conn.id;
+    }
+    get closed() {
+        return this.conn.closed;
+    }
+    sendText(data) {
+        return this.conn.wsSendText(data);
+    }
+    sendBinary(data) {
+        return this.conn.wsSendBinary(data);
     }
 }
 
@@ -161,65 +333,202 @@ function mqttClient(srv, url, opts) {
     }
 }
 
+const DEFAULT_PARAM_PATTERN = parse(":p")[0].pattern;
+const PARAM_KINDS = { "": "param", "?": "optional", "+": "oneOrMore", "*": "zeroOrMore" };
+
+// Splits a route pattern into the segments of the native router: static
+// text, parameters spanning a whole segment, and a repeated or "(.*)" last
+// parameter. Returns null for the other patterns, e.g. with custom regexps
+// or several parameters in one segment, they are matched by regexp.
+function routeSegments(urlPattern) {
+    const tokens = parse(urlPattern);
+    const segments = [];
+    for (let i = 0; i < tokens.length; i++) {
+        const t = tokens[i];
+        const last = i === tokens.length - 1;
+        if (typeof t === "string") {
+            if (t[0] !== "/") return null;
+            segments.push(...t.slice(1).split("/"));
+        } else if (t.prefix !== "/" || t.suffix !== "") {
+            return null;
+        } else if (t.pattern === ".*" && t.modifier === "" && last) {
+            segments.push({ name: t.name, kind: "catchAll" });
+        } else if (t.pattern === DEFAULT_PARAM_PATTERN && typeof t.name === "string" &&
+                (last || t.modifier === "" || t.modifier === "?")) {
+            segments.push({ name: t.name, kind: PARAM_KINDS[t.modifier] });
+        } else {
+            return null;
+        }
+    }
+    return segments.length > 0 ? segments : null;
+}
+
+// Route parameters are percent-decoded, a value that is not valid
+// percent-encoded UTF-8 is kept verbatim, as the native router does
+function decodeParam(value) {
+    try {
+        return decodeURIComponent(value);
+    } catch (e) {
+        return value;
+    }
+}
+
 function createMongooseInstance() {
     const srv = new MongooseManager();
-    const handlers = [];
-    const wsHandlers = {};
-    const wsConnections = {};
+    // Routes go into the native router, in O(path length) whatever their
+    // number. Middleware and the patterns it cannot take are tried in turn.
+    const router = srv.createRouter();
+    const linearHandlers = [];
+    let numHandlers = 0;
+    // WebSocket handler of every upgraded connection, by connection id
+    const wsConnections = new Map();
     const sntpHandlers = [];
-    let wsHandlerId = 0;
-    let wsConnectionId = 0;
     let sntpConnection = null;
     let staticFilesRoot = null;
+    let staticFilesOpts = null;
+
+    const regHandler = (method, urlPattern, callback, opts = {}) => {
+        const handler = { index: numHandlers++, callback, cache: opts.cache || null };
+        const segments = routeSegments(urlPattern);
+        if (segments !== null && router.add(handler.index, method, segments, handler)) return;
+        const matchUrl = match(urlPattern, { decode: decodeParam });
+        handler.matchFn = (req) => req.method === method && matchUrl(req.uri);
+        linearHandlers.push(handler);
+    }
+
+    const regMiddleware = (callback) => linearHandlers.push({
+        index: numHandlers++,
+        matchFn: () => true,
+        callback: (req, res, _, next) => callback(req, res, next),
+        cache: null
+    });
 
-    const regHandler = (method, urlPattern, callback) => {
-        const matchUrl = match(urlPattern, { decode: decodeURIComponent });
-        handlers.push({ matchFn: (req) => req.method === method && matchUrl(req.uri), callback });
+    // The first handler from index from on that matches the request, as
+    // { index, handler, params }
+    const findHandler = (req, from) => {
+        const routed = router.find(req.msg, from);
+        for (const h of linearHandlers) {
+            if (h.index < from) continue;
+            if (routed !== null && h.index > routed.index) break;
+            const m = h.matchFn(req);
+            if (m) return { index: h.index, handler: h, params: m.params };
+        }
+        return routed;
     }
 
-    const regCustomHandler = (method) => (urlPattern, callback) => {
-        regHandler(method, urlPattern, callback);
+    // opts.cache = { ttlMs, staleWhileRevalidateMs, vary } caches GET replies
+    const regCustomHandler = (method) => (urlPattern, callback, opts = {}) => {
+        regHandler(method, urlPattern, callback, opts);
     }
 
-    const iterateHandlers = (req, res) => {
-        let shouldStop = false;
-        const next = () => shouldStop = false;
-        for (let h of handlers) {
-            const match = h.matchFn(req);
-            if (match) {
-                shouldStop = true;
-                h.callback(req, res, match.params, next);
-                if (shouldStop) return;
+    // A handler that fails before sending anything gets a 500 reply, the
+    // error is still reported
+    const failRequest = (res, e) => {
+        if (!res.headersSent) res.status(500).send("Internal Server Error");
+        throw e;
+    }
+
+    // Handlers may return a promise and reply once it settles: the native
+    // request stays usable and later requests on the same connection wait
+    // for that reply. next() may be called after the handler returned, the
+    // chain then goes on from there.
+    const iterateHandlers = (req, res, from = 0) => {
+        for (let found = findHandler(req, from); found !== null; found = findHandler(req, found.index + 1)) {
+            const h = found.handler;
+            const after = found.index + 1;
+            let returned = false, proceed = false, called = false;
+            const next = () => {
+                if (called) return;
+                called = true;
+                if (returned) iterateHandlers(req, res, after);
+                else proceed = true;
+            }
+            let ret;
+            if (h.cache) res.cacheFor(h.cache.ttlMs, h.cache);
+            try {
+                ret = h.callback(req, res, found.params, next);
+            } catch (e) {
+                failRequest(res, e);
             }
+            returned = true;
+            if (ret !== null && typeof ret === "object" && typeof ret.then === "function")
+                ret.then(undefined, (e) => failRequest(res, e));
+            if (!proceed) return;
+        }
+        if (staticFilesRoot) res.serveDir(staticFilesRoot, staticFilesOpts);
+    }
+
+    // Streamed responses waiting for their send buffer to drain, by id
+    const drainWaiters = new Map();
+
+    const waitDrain = (msg, watermark) => {
+        const id = msg.connectionId;
+        if (!msg.httpWatchDrain(watermark)) return Promise.resolve(false);
+        return new Promise((resolve) => drainWaiters.set(id, resolve));
+    }
+
+    const resolveDrain = (id, open) => {
+        const resolve = drainWaiters.get(id);
+        if (resolve) {
+            drainWaiters.delete(id);
+            resolve(open);
         }
-        if (staticFilesRoot) res.serveDir(staticFilesRoot);
     }
 
-    srv.onHttpMessage = (msg) => {
-        const req = httpRequest(msg);
-        const res = httpResponse(msg);
+    srv.onHttpDrain = (id) => resolveDrain(id, true);
+
+    const handleHttpMessage = (msg) => {
+        const req = new HttpRequest(msg);
+        const res = new HttpResponse(msg, waitDrain);
         iterateHandlers(req, res);
     }
 
+    srv.onHttpMessage = handleHttpMessage;
+
+    // Pipelined requests of listeners created with { batchPipelined: true }.
+    // Replies go out in order: the requests after a pending one come again
+    // once it is answered.
+    srv.onHttpBatch = (msgs) => {
+        for (const msg of msgs) {
+            handleHttpMessage(msg);
+            if (msg.pending) break;
+        }
+    }
+
     srv.onWsMessage = (msg) => {
-        const wsHandlerId = wsConnections[msg.connection.label];
-        if (wsHandlerId && wsHandlerId in wsHandlers) {
-            const wsHandler = wsHandlers[wsHandlerId];
-            const req = wsRequest(msg.connection, msg);
-            const res = wsResponse(msg.connection);
+        const conn = msg.connection;
+        const wsHandler = wsConnections.get(conn.id);
+        if (wsHandler) {
+            const req = new WsRequest(conn, msg);
+            const res = wsHandler.connections.get(conn.id);
             for (let h of wsHandler.onMessage) h(req, res);
         }
     }
 
     srv.onHttpClose = (c) => {
-        if (c.label in wsConnections) {
-            const wsHandlerId = wsConnections[c.label];
-            const wsHandler = wsHandlers[wsHandlerId];
-            const res = wsResponse(c);
+        resolveDrain(c.id, false);
+        const wsHandler = wsConnections.get(c.id);
+        if (wsHandler) {
+            const res = wsHandler.connections.get(c.id);
             for (let h of wsHandler.onClose) h(res);
-            wsHandler.connections.delete(c.label);
-            delete wsConnections[c.label];
+            wsHandler.connections.delete(c.id);
+            wsConnections.delete(c.id);
+        }
+    }
+
+    // Batch mode: the events of a poll come in one call, as callbacks and
+    // their arguments in turn. A callback that throws does not hold back
+    // the others, the first error is rethrown after them.
+    const dispatchEvents = (events, count) => {
+        let error = null;
+        for (let i = 0; i < count; i += 2) {
+            try {
+                events[i](events[i + 1]);
+            } catch (e) {
+                if (error === null) error = e;
+            }
         }
+        if (error !== null) throw error;
     }
 
     srv.onSntpMessage = (time) => {
@@ -228,6 +537,8 @@ function createMongooseInstance() {
         }
     }
 
+    // A handler that throws does not stop the others, poll() throws the
+    // first error once every event of the poll ran, batched or not
     setInterval(() => srv.poll(10), 50);
 
     return {
@@ -235,24 +546,18 @@ function createMongooseInstance() {
         httpPost: regCustomHandler("POST"),
         httpPut: regCustomHandler("PUT"),
         httpDelete: regCustomHandler("DELETE"),
-        httpMiddleware: (callback) => handlers.push({ 
-            matchFn: () => true, 
-            callback: (req, res, _, next) => callback(req, res, next) 
-        }),
+        httpMiddleware: regMiddleware,
         websocketHandler: (urlPattern) => {
-            const handlerId = (wsHandlerId++).toString();
             const handler = { 
                 onOpen: [],
                 onMessage: [], 
                 onClose: [],
-                connections: new Set() 
+                connections: new Map() // WsResponse of each connection, by id
             };
-            wsHandlers[handlerId] = handler;
             regHandler("GET", urlPattern, (req, res) => {
-                const connId = (wsConnectionId++).toString();
-                wsConnections[connId] = handlerId;
-                handler.connections.add(connId);
-                const conn = res.wsUpgrade(connId);
+                const conn = res.wsUpgrade();
+                wsConnections.set(conn.connectionId, handler);
+                handler.connections.set(conn.connectionId, conn);
                 for (let h of handler.onOpen) h(req, conn);
             });
             return {
@@ -260,18 +565,57 @@ function createMongooseInstance() {
                 onMessage: (cb) => handler.onMessage.push(cb),
                 onClose: (cb) => handler.onClose.push(cb),
                 getConnections() {
-                    let conn = srv.getConnections();
-                    const res = [];
-                    while (conn !== null) { 
-                      if (handler.connections.has(conn.label)) res.push(wsResponse(conn));
-                      conn = conn.next();
-                    }
-                    return res;
+                    return [...handler.connections.values()];
+                },
+                getConnection: (id) => handler.connections.get(id) || null
+            };
+        },
+        // Server-Sent Events: every GET on urlPattern subscribes to the
+        // handler's events. Each broadcast is formatted once natively and
+        // copied to all subscribers, and idle streams get a heartbeat.
+        sseHandler: (urlPattern, { heartbeatMs = 15000, retryMs = null, maxBuffered = 1024 * 1024 } = {}) => {
+            const group = srv.createSseGroup(maxBuffered);
+            const heartbeat = heartbeatMs > 0 ? setInterval(() => group.comment(""), heartbeatMs) : null;
+            regHandler("GET", urlPattern, (req, res) => res.sseSubscribe(group, retryMs));
+            return {
+                broadcast: (data, { event = null, id = null } = {}) =>
+                    group.broadcast(typeof data === "string" ? data : JSON.stringify(data), event, id),
+                comment: (text) => group.comment(text),
+                get size() { return group.size },
+                close() {
+                    if (heartbeat !== null) clearInterval(heartbeat);
+                    group.close();
                 }
             };
         },
-        setStaticFilesRoot: (filesRoot) => { staticFilesRoot = filesRoot },
-        httpListen: (listenUrl) => srv.httpListen(listenUrl),
+        setStaticFilesRoot: (filesRoot, opts = null) => {
+            staticFilesRoot = filesRoot;
+            staticFilesOpts = opts;
+        },
+        setServerHeader: (name) => { srv.serverHeader = name },
+        // Opt-in: fewer transitions from native code into JS on busy servers,
+        // callbacks then run once the poll is over rather than during it
+        setEventBatching: (enabled) => { srv.onEventBatch = enabled ? dispatchEvents : undefined },
+        setStaticCache: (entries = 256, ttlMs = 1000) => srv.enableStatCache(entries, ttlMs),
+        setAssetCache: (budget = 8 * 1024 * 1024, maxAssetSize = 256 * 1024) =>
+            srv.enableAssetCache(budget, maxAssetSize),
+        getAssetCacheStats: () => srv.assetCacheStats,
+        setResponseCache: (budget = 8 * 1024 * 1024) => srv.enableResponseCache(budget),
+        getResponseCacheStats: () => srv.responseCacheStats,
+        // Keeps collections between bursts: idle ones once no event came
+        // for idleGcMs, and a gcThreshold high enough that QuickJS seldom
+        // starts one on its own. Options left out are unchanged.
+        setMemoryOptions: ({ memoryLimit, gcThreshold, idleGcMs } = {}) => {
+            if (memoryLimit !== undefined) srv.memoryLimit = memoryLimit;
+            if (gcThreshold !== undefined) srv.gcThreshold = gcThreshold;
+            if (idleGcMs !== undefined) srv.enableIdleGc(idleGcMs);
+        },
+        gc: () => srv.gc(),
+        getMemoryUsage: () => srv.memoryUsage,
+        getGcStats: () => srv.gcStats,
+        httpListen: (listenUrl, opts = {}) => srv.httpListen(listenUrl, opts),
+        // The MongooseConnection of an open connection, in O(1)
+        getConnection: (id) => srv.getConnection(id),
         onSntpTime: (fn) => {
             if (!sntpConnection) {
                 sntpConnection = srv.sntpConnect();
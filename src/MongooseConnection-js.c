@@ -1,8 +1,11 @@
 #include "MongooseConnection-js.h"
+#include "MongooseManager-js.h"
 
 typedef struct {
     JSContext *ctx;
-    struct mg_connection *conn;
+    struct mg_connection *conn;     // NULL once closed
+    unsigned long id;
+    JSValue self;                   // Held by the connection while it is open
 } mgConnObj;
 
 static mgConnObj* getMgConnObj(JSValueConst this_val) 
@@ -25,55 +28,134 @@ static void mgConnGcMark(JSRuntime *rt, JSValueConst val, JS_MarkFunc *mark_func
     }
 }
 
-JSValue mgConnCreate(JSContext *ctx, struct mg_connection *conn)
+// The handle lives in the manager's connection map, which holds a
+// reference to it until the connection closes
+JSValue mgConnGet(JSContext *ctx, struct mg_connection *conn)
 {
-    JSValue obj = JS_NewObjectClass(ctx, mgConnClass.id);
+    mgConnMapEntry *e;
     mgConnObj *state;
-    state = js_mallocz(ctx, sizeof(*state));
+    JSValue obj;
+    if (conn == NULL) return JS_NULL;
+    if ((e = mgConnMapPut(mgMgrGetConnMap(conn->mgr), conn)) == NULL)
+        return JS_ThrowOutOfMemory(ctx);
+    if (e->handle != NULL)
+        return JS_DupValue(ctx, ((mgConnObj *) e->handle)->self);
+    obj = JS_NewObjectClass(ctx, mgConnClass.id);
+    if (JS_IsException(obj)) return obj;
+    if ((state = js_mallocz(ctx, sizeof(*state))) == NULL) 
+    {
+        JS_FreeValue(ctx, obj);
+        return JS_ThrowOutOfMemory(ctx);
+    }
     state->ctx = ctx;
     state->conn = conn;
+    state->id = conn->id;
+    state->self = JS_DupValue(ctx, obj);
     JS_SetOpaque(obj, state);
+    e->handle = state;
     return obj;
 }
 
-static JSValue mgConnGetLabel(JSContext *ctx, JSValueConst this_val)
+// Connections mongoose opens for itself, like the DNS resolver's, never
+// reach mgConnClosed(): a handle would outlive them. Only the ones
+// registered by mgConnOpened() are listed.
+JSValue mgConnGetFrom(JSContext *ctx, struct mg_connection *conn)
+{
+    while (conn != NULL && mgConnMapGet(mgMgrGetConnMap(conn->mgr), conn->id) == NULL)
+        conn = conn->next;
+    return mgConnGet(ctx, conn);
+}
+
+JSValue mgConnFind(JSContext *ctx, struct mg_mgr *mgr, unsigned long id)
+{
+    mgConnMapEntry *e = mgConnMapGet(mgMgrGetConnMap(mgr), id);
+    return e == NULL ? JS_NULL : mgConnGet(ctx, e->conn);
+}
+
+void mgConnOpened(struct mg_connection *conn)
+{
+    // Out of memory, the connection is only found once it has a handle
+    mgConnMapPut(mgMgrGetConnMap(conn->mgr), conn);
+}
+
+void mgConnClosed(JSContext *ctx, struct mg_connection *conn)
+{
+    mgConnMap *map = mgMgrGetConnMap(conn->mgr);
+    mgConnMapEntry *e = mgConnMapGet(map, conn->id);
+    mgConnObj *state;
+    if (e == NULL) return;
+    state = e->handle;
+    mgConnMapRemove(map, conn->id);
+    if (state != NULL) 
+    {
+        state->conn = NULL;
+        JS_FreeValue(ctx, state->self);
+    }
+}
+
+static struct mg_connection *getLiveConn(JSContext *ctx, JSValueConst this_val)
 {
     mgConnObj *state = getMgConnObj(this_val);
-    return JS_NewString(ctx, state->conn->label);
+    if (state->conn == NULL)
+        JS_ThrowTypeError(ctx, "connection %lu is closed", state->id);
+    return state->conn;
+}
+
+static JSValue mgConnGetLabel(JSContext *ctx, JSValueConst this_val)
+{
+    struct mg_connection *c = getLiveConn(ctx, this_val);
+    if (c == NULL) return JS_EXCEPTION;
+    return JS_NewString(ctx, c->label);
 }
 
 static JSValue mgConnSetLabel(JSContext *ctx, JSValueConst this_val, JSValueConst value)
 {
-    mgConnObj *state = getMgConnObj(this_val);
-    size_t labelLen;
-    char *label = JS_ToCStringLen(ctx, &labelLen, value);
-    size_t len = MIN(labelLen, sizeof(state->conn->label) - 1);
-    strncpy(state->conn->label, label, len);
-    state->conn->label[len] = '\0';
+    struct mg_connection *c = getLiveConn(ctx, this_val);
+    size_t labelLen, len;
+    char *label;
+    if (c == NULL) return JS_EXCEPTION;
+    if ((label = JS_ToCStringLen(ctx, &labelLen, value)) == NULL)
+        return JS_EXCEPTION;
+    len = MIN(labelLen, sizeof(c->label) - 1);
+    strncpy(c->label, label, len);
+    c->label[len] = '\0';
     JS_FreeCString(ctx, label);
     return JS_UNDEFINED;
 }
 
+// Still known once the connection is closed
+static JSValue mgConnGetId(JSContext *ctx, JSValueConst this_val)
+{
+    mgConnObj *state = getMgConnObj(this_val);
+    return JS_NewInt64(ctx, (int64_t) state->id);
+}
+
+static JSValue mgConnGetClosed(JSContext *ctx, JSValueConst this_val)
+{
+    mgConnObj *state = getMgConnObj(this_val);
+    return JS_NewBool(ctx, state->conn == NULL);
+}
+
 static JSValue mgConnNext(
     JSContext *ctx, JSValueConst this_val,
     int argc, JSValueConst *argv, int magic)
 {
-    mgConnObj *state = getMgConnObj(this_val);
-    if (state->conn->next == NULL)
-        return JS_NULL;
-    else 
-        return mgConnCreate(ctx, state->conn->next);
+    struct mg_connection *c = getLiveConn(ctx, this_val);
+    if (c == NULL) return JS_EXCEPTION;
+    return mgConnGetFrom(ctx, c->next);
 }
 
 static JSValue mgConnSntpRequest(
     JSContext *ctx, JSValueConst this_val,
     int argc, JSValueConst *argv)
 {
-    mgConnObj *state = getMgConnObj(this_val);
+    struct mg_connection *c = getLiveConn(ctx, this_val);
     time_t secs;
+    if (c == NULL) return JS_EXCEPTION;
     if (argc > 0 && JS_IsNumber(argv[0]))
         JS_ToInt64(ctx, &secs, argv[0]);
-    mg_sntp_request(state->conn);
+    mg_sntp_request(c);
+    return JS_UNDEFINED;
 }
 
 static JSValue mgConnWsSend(
@@ -83,19 +165,24 @@ static JSValue mgConnWsSend(
     mgConnObj *state = getMgConnObj(this_val);
     char* data;
     size_t len;
+    // Like HTTP writes, sending to a closed connection is not an error
+    if (state->conn == NULL) return JS_FALSE;
     data = magic == WEBSOCKET_OP_TEXT 
         ? JS_ToCStringLen(ctx, &len, argv[0]) 
         : JS_GetArrayBuffer(ctx, &len, argv[0]);
+    if (data == NULL) return JS_EXCEPTION;
     mg_ws_send(state->conn, data, len, magic);
     if (magic == WEBSOCKET_OP_TEXT) 
         JS_FreeCString(ctx, data);
-    return JS_UNDEFINED;
+    return JS_TRUE;
 }
 
 static JSCFunctionListEntry mgConnClassFuncs[] = {
     JS_CFUNC_MAGIC_DEF("wsSendBinary", 1, mgConnWsSend, WEBSOCKET_OP_BINARY),
     JS_CFUNC_MAGIC_DEF("wsSendText", 1, mgConnWsSend, WEBSOCKET_OP_TEXT),
     JS_CGETSET_DEF("label", mgConnGetLabel, mgConnSetLabel),
+    JS_CGETSET_DEF("id", mgConnGetId, NULL),
+    JS_CGETSET_DEF("closed", mgConnGetClosed, NULL),
     JS_CFUNC_DEF("next", 0, mgConnNext),
     JS_CFUNC_DEF("sntpRequest", 0, mgConnSntpRequest)
 };
@@ -5,6 +5,20 @@
 #include "js-utils.h"
 
 extern JSFullClassDef mgConnClass;
-JSValue mgConnCreate(JSContext *ctx, struct mg_connection *conn);
+// The JS handle of a connection: created on first use, then the same
+// object until the connection closes. JS_NULL when conn is NULL. conn has
+// to be one of the bindings' connections, whose close calls mgConnClosed().
+JSValue mgConnGet(JSContext *ctx, struct mg_connection *conn);
+// Handle of conn, or of the first connection after it in the manager's
+// list that has been opened through the bindings. JS_NULL if none.
+JSValue mgConnGetFrom(JSContext *ctx, struct mg_connection *conn);
+// Handle of the connection with that id, JS_NULL if it is not open
+JSValue mgConnFind(JSContext *ctx, struct mg_mgr *mgr, unsigned long id);
+// Called on MG_EV_OPEN, so that the connection can be found by id before
+// it has a handle
+void mgConnOpened(struct mg_connection *conn);
+// Called once MG_EV_CLOSE has been handled: the handle stays, but its
+// methods throw from then on
+void mgConnClosed(JSContext *ctx, struct mg_connection *conn);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,129 @@
+#include "MongooseHttpHeaders-js.h"
+#include "MongooseHttpMessage-js.h"
+
+// Read-only view over the headers of a MongooseHttpMessage. Nothing is
+// copied up front: properties are resolved case-insensitively against
+// hm->headers when they are read or enumerated.
+typedef struct {
+    JSContext *ctx;
+    JSValue jsMsg;
+} mgHttpHeadersObj;
+
+static mgHttpHeadersObj* getMgHttpHeadersObj(JSValueConst this_val) 
+{
+    return JS_GetOpaque(this_val, mgHttpHeadersClass.id);
+}
+
+static void mgHttpHeadersFinalizer(JSRuntime *rt, JSValue val) 
+{
+    mgHttpHeadersObj *state = getMgHttpHeadersObj(val);
+    JS_FreeValueRT(rt, state->jsMsg);
+    js_free(state->ctx, state);
+}
+
+static void mgHttpHeadersGcMark(JSRuntime *rt, JSValueConst val, JS_MarkFunc *mark_func) 
+{
+    mgHttpHeadersObj *state = getMgHttpHeadersObj(val);
+    if (state) 
+        JS_MarkValue(rt, state->jsMsg, mark_func);
+}
+
+JSValue mgHttpHeadersCreate(JSContext *ctx, JSValueConst httpMsg)
+{
+    JSValue obj = JS_NewObjectClass(ctx, mgHttpHeadersClass.id);
+    mgHttpHeadersObj *state;
+    state = js_mallocz(ctx, sizeof(*state));
+    state->ctx = ctx;
+    state->jsMsg = JS_DupValue(ctx, httpMsg);
+    JS_SetOpaque(obj, state);
+    return obj;
+}
+
+static struct mg_http_message *getHeadersMsg(JSValueConst obj)
+{
+    mgHttpHeadersObj *state = getMgHttpHeadersObj(obj);
+    return state == NULL ? NULL : mgHttpMsgGetMessage(state->jsMsg);
+}
+
+static bool isDuplicateHeader(struct mg_http_message *msg, int idx)
+{
+    struct mg_str *name = &msg->headers[idx].name;
+    for (int i = 0; i < idx; i++) {
+        struct mg_str *prev = &msg->headers[i].name;
+        if (prev->len == name->len && mg_ncasecmp(prev->ptr, name->ptr, name->len) == 0)
+            return true;
+    }
+    return false;
+}
+
+static int mgHttpHeadersGetOwnProperty(
+    JSContext *ctx, JSPropertyDescriptor *desc, 
+    JSValueConst obj, JSAtom prop)
+{
+    struct mg_http_message *msg = getHeadersMsg(obj);
+    const char *name;
+    struct mg_str *val;
+    if (msg == NULL) return 0;
+    name = JS_AtomToCString(ctx, prop);
+    if (name == NULL) return -1;
+    val = mg_http_get_header(msg, name);
+    JS_FreeCString(ctx, name);
+    if (val == NULL) return 0;
+    if (desc) {
+        desc->flags = JS_PROP_ENUMERABLE;
+        desc->value = JS_NewStringLen(ctx, val->ptr, val->len);
+        desc->getter = JS_UNDEFINED;
+        desc->setter = JS_UNDEFINED;
+    }
+    return 1;
+}
+
+static int mgHttpHeadersGetOwnPropertyNames(
+    JSContext *ctx, JSPropertyEnum **ptab, 
+    uint32_t *plen, JSValueConst obj)
+{
+    struct mg_http_message *msg = getHeadersMsg(obj);
+    JSPropertyEnum *tab = NULL;
+    uint32_t len = 0;
+    int count = 0;
+    if (msg != NULL) 
+        while (count < MG_MAX_HTTP_HEADERS && msg->headers[count].name.len > 0) count++;
+    if (count > 0) 
+    {
+        tab = js_malloc(ctx, sizeof(*tab) * count);
+        if (tab == NULL) return -1;
+        for (int i = 0; i < count; i++) {
+            struct mg_str *name = &msg->headers[i].name;
+            if (isDuplicateHeader(msg, i)) continue;
+            tab[len].is_enumerable = true;
+            tab[len].atom = JS_NewAtomLen(ctx, name->ptr, name->len);
+            if (tab[len].atom == JS_ATOM_NULL) 
+            {
+                while (len > 0) JS_FreeAtom(ctx, tab[--len].atom);
+                js_free(ctx, tab);
+                return -1;
+            }
+            len++;
+        }
+    }
+    *ptab = tab;
+    *plen = len;
+    return 0;
+}
+
+static JSClassExoticMethods mgHttpHeadersExoticMethods = {
+    .get_own_property = mgHttpHeadersGetOwnProperty,
+    .get_own_property_names = mgHttpHeadersGetOwnPropertyNames,
+};
+
+JSFullClassDef mgHttpHeadersClass = {
+    .def = {
+        .class_name = "MongooseHttpHeaders",
+        .finalizer = mgHttpHeadersFinalizer,
+        .gc_mark = mgHttpHeadersGcMark,
+        .exotic = &mgHttpHeadersExoticMethods,
+    },
+    .constructor = { NULL, 0 },
+    .funcs_len = 0,
+    .funcs = NULL
+};
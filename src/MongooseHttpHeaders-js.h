@@ -0,0 +1,10 @@
+#ifndef __MONGOOSE_HTTP_HEADERS_JS_H
+#define __MONGOOSE_HTTP_HEADERS_JS_H
+
+#include "mongoose.h"
+#include "js-utils.h"
+
+extern JSFullClassDef mgHttpHeadersClass;
+JSValue mgHttpHeadersCreate(JSContext *ctx, JSValueConst httpMsg);
+
+#endif
@@ -1,12 +1,9 @@
 #include "MongooseHttpMessage-js.h"
 #include "MongooseConnection-js.h"
-
-static char *mg_str_to_cstr(struct mg_str *src, char *dest, size_t dest_size) {
-  int bytesToCopy = MIN(src->len, dest_size - 1);
-  strncpy(dest, src->ptr, bytesToCopy);
-  dest[bytesToCopy] = '\0';
-  return dest;
-}
+#include "MongooseHttpHeaders-js.h"
+#include "MongooseResponseHeaders-js.h"
+#include "MongooseManager-js.h"
+#include "MongooseSseGroup-js.h"
 
 enum {
     MG_MSG_PROP_URI,
@@ -16,12 +13,24 @@ enum {
     MG_MSG_PROP_MESSAGE
 };
 
-typedef struct {
+typedef struct mgHttpMsgObj {
     JSContext *ctx;
+    mgObjPool *pool;
     struct mg_connection *conn;
     struct mg_http_message *msg;
-    JSValue jsConnection;
+    struct mg_mgr *mgr;
+    unsigned long connId;
     JSValue jsHeaders;
+    JSValue jsQueryParams;
+    JSValue jsResponseHeaders;
+    mgCompressStream *stream;
+    mgRespCachePolicy *cachePolicy;
+    struct mg_http_message *pinned; // Copy of the request, see mgHttpMsgRelease()
+    bool inEvent;                   // conn and msg are those of the running event
+    bool done;                      // The reply is complete
+    bool started;                   // The status line of a streamed reply was sent
+    bool paused;                    // Pipelined requests wait for the reply
+    struct mgHttpMsgObj *prev;      // Batched before this one, see mgHttpMsgSetPrevious()
 } mgHttpMsgObj;
 
 static mgHttpMsgObj* getMgHttpMsgObj(JSValueConst this_val) 
@@ -32,9 +41,16 @@ static mgHttpMsgObj* getMgHttpMsgObj(JSValueConst this_val)
 static void mgHttpMsgFinalizer(JSRuntime *rt, JSValue val) 
 {
     mgHttpMsgObj *state = getMgHttpMsgObj(val);
-    JS_FreeValueRT(rt, state->jsConnection);
     JS_FreeValueRT(rt, state->jsHeaders);
-    js_free(state->ctx, state);
+    JS_FreeValueRT(rt, state->jsQueryParams);
+    JS_FreeValueRT(rt, state->jsResponseHeaders);
+    mgCompressStreamFree(state->stream);
+    mgRespCachePolicyFree(state->cachePolicy);
+    js_free(state->ctx, state->pinned);
+    if (state->pool != NULL)
+        mgObjPoolPut(state->pool, state);
+    else
+        js_free(state->ctx, state);
 }
 
 static void mgHttpMsgGcMark(JSRuntime *rt, JSValueConst val, JS_MarkFunc *mark_func) 
@@ -42,49 +58,248 @@ static void mgHttpMsgGcMark(JSRuntime *rt, JSValueConst val, JS_MarkFunc *mark_f
     mgHttpMsgObj *state = getMgHttpMsgObj(val);
     if (state) 
     {
-        JS_MarkValue(rt, state->jsConnection, mark_func);
         JS_MarkValue(rt, state->jsHeaders, mark_func);
+        JS_MarkValue(rt, state->jsQueryParams, mark_func);
+        JS_MarkValue(rt, state->jsResponseHeaders, mark_func);
     }
 }
 
-JSValue mgHttpMsgCreate(JSContext *ctx, struct mg_connection *conn, struct mg_http_message *msg)
+mgObjPool *mgHttpMsgPoolNew(JSContext *ctx, size_t maxIdle)
+{
+    return mgObjPoolNew(JS_GetRuntime(ctx), sizeof(mgHttpMsgObj), maxIdle);
+}
+
+JSValue mgHttpMsgCreate(JSContext *ctx, mgObjPool *pool, struct mg_connection *conn, struct mg_http_message *msg)
 {
     JSValue obj = JS_NewObjectClass(ctx, mgHttpMsgClass.id);
     mgHttpMsgObj *state;
-    state = js_mallocz(ctx, sizeof(*state));
+    if (JS_IsException(obj)) return obj;
+    state = pool != NULL ? mgObjPoolGet(pool) : js_mallocz(ctx, sizeof(*state));
+    if (state == NULL) 
+    {
+        JS_FreeValue(ctx, obj);
+        return JS_ThrowOutOfMemory(ctx);
+    }
     state->ctx = ctx;
+    state->pool = pool;
     state->conn = conn;
     state->msg = msg;
-    state->jsConnection = JS_UNDEFINED;
+    state->mgr = conn->mgr;
+    state->connId = conn->id;
+    state->inEvent = true;
     state->jsHeaders = JS_UNDEFINED;
+    state->jsQueryParams = JS_UNDEFINED;
+    state->jsResponseHeaders = JS_UNDEFINED;
     JS_SetOpaque(obj, state);
     return obj;
 }
 
+struct mg_http_message *mgHttpMsgGetMessage(JSValueConst obj)
+{
+    mgHttpMsgObj *state = getMgHttpMsgObj(obj);
+    return state == NULL ? NULL : state->msg;
+}
+
+// A deferred or streamed reply outlives the event that created the
+// message, by then the connection may be closed and freed. Connection ids
+// are never reused by a manager, so a late reply finds no connection and
+// becomes a no-op. Returns NULL in that case.
+static struct mg_connection *mgHttpMsgConn(mgHttpMsgObj *state)
+{
+    mgConnMapEntry *e;
+    if (state->inEvent) return state->conn;
+    e = mgConnMapGet(mgMgrGetConnMap(state->mgr), state->connId);
+    return e == NULL ? NULL : e->conn;
+}
+
+// Requests are only kept past their event while their reply is pending
+static struct mg_http_message *getMessage(JSContext *ctx, mgHttpMsgObj *state)
+{
+    if (state->msg == NULL)
+        JS_ThrowTypeError(ctx, "the request was answered and is no longer available");
+    return state->msg;
+}
+
+// A request is answered once. Later replies, e.g. a second send() or one
+// arriving after a timeout answered, write nothing: the bytes would be
+// taken for the response to the next pipelined request.
+static bool mgHttpMsgAnswered(mgHttpMsgObj *state)
+{
+    return state->done || state->started;
+}
+
+// In a batch of pipelined requests, a reply may only be written once the
+// ones before it are complete, so that the replies keep their order
+static bool mgHttpMsgInTurn(JSContext *ctx, mgHttpMsgObj *state, struct mg_connection *c)
+{
+    bool blocked = state->prev != NULL && c->is_paused; // An earlier file is being sent
+    for (mgHttpMsgObj *p = state->prev; p != NULL && !blocked; p = p->prev)
+        blocked = !p->done;
+    if (blocked)
+        JS_ThrowTypeError(ctx, "an earlier pipelined request has not been answered yet");
+    return !blocked;
+}
+
+// Marks the reply complete, and lets the connection handle the requests
+// that were held behind a deferred one. They run from the next poll, not
+// nested in the handler that is replying.
+static void mgHttpMsgFinish(mgHttpMsgObj *state, struct mg_connection *c)
+{
+    state->done = true;
+    if (state->paused && c != NULL) 
+    {
+        state->paused = false;
+        c->is_resuming = 1;
+    }
+}
+
+static void rebaseStr(struct mg_str *s, const struct mg_str *from, char *to)
+{
+    if (s->ptr != NULL && s->ptr >= from->ptr && s->ptr + s->len <= from->ptr + from->len)
+        s->ptr = to + (s->ptr - from->ptr);
+    else
+        *s = mg_str_n(to, 0);
+}
+
+// Copies a request, whose strings all point into its message
+static void pinMessage(struct mg_http_message *dst, const struct mg_http_message *src, char *buf)
+{
+    *dst = *src;
+    memcpy(buf, src->message.ptr, src->message.len);
+    rebaseStr(&dst->method, &src->message, buf);
+    rebaseStr(&dst->uri, &src->message, buf);
+    rebaseStr(&dst->query, &src->message, buf);
+    rebaseStr(&dst->proto, &src->message, buf);
+    for (int i = 0; i < MG_MAX_HTTP_HEADERS; i++) 
+    {
+        rebaseStr(&dst->headers[i].name, &src->message, buf);
+        rebaseStr(&dst->headers[i].value, &src->message, buf);
+    }
+    rebaseStr(&dst->body, &src->message, buf);
+    rebaseStr(&dst->head, &src->message, buf);
+    rebaseStr(&dst->chunk, &src->message, buf);
+    rebaseStr(&dst->message, &src->message, buf);
+}
+
+bool mgHttpMsgRelease(JSValueConst obj, bool pause)
+{
+    mgHttpMsgObj *state = getMgHttpMsgObj(obj);
+    struct mg_http_message *pinned;
+    if (state == NULL || !state->inEvent) return false;
+    state->inEvent = false;
+    state->prev = NULL;
+    if (state->done) 
+    {
+        state->msg = NULL;
+        return false;
+    }
+    pinned = js_malloc(state->ctx, sizeof(*pinned) + state->msg->message.len);
+    if (pinned != NULL)
+        pinMessage(pinned, state->msg, (char *) (pinned + 1));
+    state->msg = state->pinned = pinned;
+    if (pause && !state->conn->is_paused) 
+    {
+        state->conn->is_paused = 1;
+        state->conn->is_full = 1; // Do not buffer more requests meanwhile
+        state->paused = true;
+    }
+    return true;
+}
+
+void mgHttpMsgSetPrevious(JSValueConst obj, JSValueConst prev)
+{
+    mgHttpMsgObj *state = getMgHttpMsgObj(obj);
+    if (state != NULL && state->inEvent) state->prev = getMgHttpMsgObj(prev);
+}
+
+void mgHttpMsgDrop(JSValueConst obj)
+{
+    mgHttpMsgObj *state = getMgHttpMsgObj(obj);
+    if (state == NULL || !state->inEvent) return;
+    state->inEvent = false;
+    state->prev = NULL;
+    state->msg = NULL;
+    state->done = true;
+    state->connId = 0; // Ids start at 1, late replies find no connection
+}
+
+// Extra response headers are given either as a string or as a
+// MongooseResponseHeaders object, whose serialized lines are borrowed.
+// *str receives the C string to release with JS_FreeCString, if any.
+static const char *toExtraHeaders(JSContext *ctx, JSValueConst val, const char **str)
+{
+    const char *block = mgRespHeadersGetBlock(val, NULL);
+    *str = NULL;
+    if (block != NULL) return block;
+    if (JS_IsUndefined(val) || JS_IsNull(val)) return NULL;
+    *str = JS_ToCString(ctx, val);
+    return *str;
+}
+
+// Filesystem by name: "posix" (default) or "packed", the files compiled
+// in with qjs_mongoose_pack_dir()
+static int toFs(JSContext *ctx, JSValueConst val, struct mg_fs **fs)
+{
+    const char *name;
+    *fs = NULL;
+    if (JS_IsUndefined(val) || JS_IsNull(val)) return 0;
+    if ((name = JS_ToCString(ctx, val)) == NULL) return -1;
+    if (strcmp(name, "packed") == 0)
+        *fs = &mg_fs_packed;
+    else if (strcmp(name, "posix") != 0) 
+    {
+        JS_ThrowTypeError(ctx, "unknown filesystem: %s", name);
+        JS_FreeCString(ctx, name);
+        return -1;
+    }
+    JS_FreeCString(ctx, name);
+    return 0;
+}
+
 static JSValue mgHttpMsgHttpServe(
     JSContext *ctx, JSValueConst this_val,
     int argc, JSValueConst *argv, int magic)
 {
     mgHttpMsgObj *state = getMgHttpMsgObj(this_val);
-    const char *path = JS_ToCString(ctx, argv[0]);
+    struct mg_connection *c = mgHttpMsgConn(state);
+    struct mg_http_message *msg = getMessage(ctx, state);
+    const char *path;
     const char *extraHeaders = NULL; 
+    const char *extraHeadersStr = NULL; 
     const char *mineTypes = NULL; 
+    struct mg_fs *fs = NULL;
+    if (msg == NULL) return JS_EXCEPTION;
+    if (c == NULL || mgHttpMsgAnswered(state)) return JS_UNDEFINED;
+    if (!mgHttpMsgInTurn(ctx, state, c)) return JS_EXCEPTION;
+    if (argc > 3 && toFs(ctx, argv[3], &fs) != 0)
+        return JS_EXCEPTION;
+    path = JS_ToCString(ctx, argv[0]);
     if (argc > 1)
-        extraHeaders = JS_ToCString(ctx, argv[1]);
-    if (argc > 2)
+        extraHeaders = toExtraHeaders(ctx, argv[1], &extraHeadersStr);
+    if (argc > 2 && !JS_IsUndefined(argv[2]) && !JS_IsNull(argv[2]))
         mineTypes = JS_ToCString(ctx, argv[2]);
-    struct mg_http_message *msg = state->msg;
     struct mg_http_serve_opts opts = { 
         .root_dir = path, 
         .extra_headers = extraHeaders, 
-        .mime_types = mineTypes 
+        .mime_types = mineTypes,
+        .fs = fs
     };
+    mg_event_handler_t pfn = c->pfn;
     if (magic == 0)
-        mg_http_serve_dir(state->conn, msg, &opts);
+        mg_http_serve_dir(c, msg, &opts);
+    else
+        mg_http_serve_file(c, msg, path, &opts);
+    if (c->pfn != pfn) 
+    {
+        // The body is still being sent. The connection stays paused until
+        // it is, and mongoose resumes it then.
+        state->done = true;
+        state->paused = false;
+    }
     else
-        mg_http_serve_file(state->conn, msg, path, &opts);
+        mgHttpMsgFinish(state, c);
     JS_FreeCString(ctx, path);
-    JS_FreeCString(ctx, extraHeaders);
+    JS_FreeCString(ctx, extraHeadersStr);
     JS_FreeCString(ctx, mineTypes);
     return JS_UNDEFINED;
 }
@@ -94,41 +309,331 @@ static JSValue mgHttpMsgWsUpgrade(
     int argc, JSValueConst *argv)
 {
     mgHttpMsgObj *state = getMgHttpMsgObj(this_val);
-    struct mg_http_message *msg = state->msg;
-    mg_ws_upgrade(state->conn, msg, NULL);
+    struct mg_connection *c = mgHttpMsgConn(state);
+    struct mg_http_message *msg = getMessage(ctx, state);
+    if (msg == NULL) return JS_EXCEPTION;
+    if (c == NULL || mgHttpMsgAnswered(state)) return JS_UNDEFINED;
+    if (!mgHttpMsgInTurn(ctx, state, c)) return JS_EXCEPTION;
+    mg_ws_upgrade(c, msg, NULL);
+    mgHttpMsgFinish(state, c);
     return JS_UNDEFINED;
 }
 
+// Finds a header in a "Name: value\r\n" block
+static bool findHeaderLine(const char *block, const char *name, struct mg_str *value)
+{
+    size_t n = strlen(name);
+    const char *p = block, *end;
+    while (p != NULL && *p != '\0') 
+    {
+        if (mg_ncasecmp(p, name, n) == 0 && p[n] == ':') 
+        {
+            for (p += n + 1; *p == ' '; p++);
+            for (end = p; *end != '\0' && *end != '\r' && *end != '\n'; end++);
+            *value = mg_str_n(p, end - p);
+            return true;
+        }
+        if ((p = strchr(p, '\n')) != NULL) p++;
+    }
+    return false;
+}
+
+// Whether the listener compresses this response. Responses that already
+// carry a Content-Encoding or have an incompressible type are left alone.
+static bool mgHttpMsgMayCompress(mgHttpMsgObj *state, struct mg_connection *c,
+    const char *headers, size_t len)
+{
+    const mgCompressOpts *opts = mgMgrGetCompressOpts(c);
+    struct mg_str type;
+    if (opts == NULL || opts->level == 0 || state->msg == NULL || len < opts->minSize)
+        return false;
+    if (headers == NULL) return true;
+    if (findHeaderLine(headers, "Content-Encoding", &type)) return false;
+    return !findHeaderLine(headers, "Content-Type", &type) || mgCompressibleType(&type);
+}
+
+// Appends the framing, Content-Encoding and Vary headers to the extra
+// headers. A negative encoding means that none was negotiated, so the
+// response does not vary. *buf is to be freed when it is not mem anymore.
+static const char *withEncodingHeaders(
+    const char *headers, const char *framing, int encoding, char **buf, size_t size)
+{
+    bool encoded = encoding > MG_ENCODING_IDENTITY;
+    mg_asprintf(buf, size, "%s%s%s%s%s%s",
+        headers ? headers : "", framing,
+        encoded ? "Content-Encoding: " : "",
+        encoded ? mgCompressEncodingName(encoding) : "",
+        encoded ? "\r\n" : "",
+        encoding >= 0 ? "Vary: Accept-Encoding\r\n" : "");
+    return *buf;
+}
+
 static JSValue mgHttpMsgHttpReply(
     JSContext *ctx, JSValueConst this_val,
     int argc, JSValueConst *argv)
 {
     mgHttpMsgObj *state = getMgHttpMsgObj(this_val);
     int status;
-    char *headers;
-    char *body;
+    const char *headers = NULL;
+    const char *headersStr = NULL;
+    struct mg_connection *c = mgHttpMsgConn(state);
+    mgRespCache *cache;
+    size_t start;
+    JSBytes body;
     if (JS_ToInt32(ctx, &status, argv[0]) != 0)
         return JS_ThrowTypeError(ctx, "status code in not a number");
-    headers = JS_ToCString(ctx, argv[1]);
-    body = JS_ToCString(ctx, argv[2]);
-    mg_http_reply(state->conn, status, headers, "%s", body);
-    JS_FreeCString(ctx, headers);
-    JS_FreeCString(ctx, body);
-    return JS_UNDEFINED;
+    if (c == NULL || mgHttpMsgAnswered(state)) return JS_FALSE;
+    if (!mgHttpMsgInTurn(ctx, state, c)) return JS_EXCEPTION;
+    if (JS_GetBytes(ctx, argc > 2 ? argv[2] : JS_UNDEFINED, &body) != 0)
+        return JS_EXCEPTION;
+    start = c->send.len;
+    if (argc > 1)
+        headers = toExtraHeaders(ctx, argv[1], &headersStr);
+    if ((argc < 4 || JS_ToBool(ctx, argv[3])) && mgHttpMsgMayCompress(state, c, headers, body.len)) 
+    {
+        const mgCompressOpts *opts = mgMgrGetCompressOpts(c);
+        int encoding = mgCompressNegotiate(
+            mg_http_get_header(state->msg, "Accept-Encoding"), opts->brotli);
+        struct mg_iobuf out = { NULL, 0, 0 };
+        char mem[512], *buf = mem;
+        if (encoding != MG_ENCODING_IDENTITY && (
+                mgCompressBuffer(encoding, opts->level, body.ptr, body.len, &out) != 0 ||
+                out.len >= body.len))
+            encoding = MG_ENCODING_IDENTITY; // Not worth it, send as is
+        withEncodingHeaders(headers, "", encoding, &buf, sizeof(mem));
+        if (encoding == MG_ENCODING_IDENTITY)
+            mg_http_reply_buf(c, status, buf, body.ptr, body.len);
+        else
+            mg_http_reply_buf(c, status, buf, out.buf, out.len);
+        mg_iobuf_free(&out);
+        if (buf != mem) free(buf);
+    }
+    else
+        mg_http_reply_buf(c, status, headers, body.ptr, body.len);
+    // The whole reply went to the send buffer, keep a copy if asked to
+    if (state->cachePolicy != NULL && (cache = mgMgrGetRespCache(c)) != NULL)
+        mgRespCacheStore(cache, state->cachePolicy, c->send.buf + start, c->send.len - start);
+    mgRespCachePolicyFree(state->cachePolicy);
+    state->cachePolicy = NULL;
+    JS_FreeCString(ctx, headersStr);
+    JS_FreeBytes(ctx, &body);
+    mgHttpMsgFinish(state, c);
+    return JS_TRUE;
+}
+
+// Starts a chunked response. The body sent with httpWrite() is compressed
+// on the fly when the listener and the client both allow it.
+static JSValue mgHttpMsgHttpWriteHead(
+    JSContext *ctx, JSValueConst this_val,
+    int argc, JSValueConst *argv)
+{
+    mgHttpMsgObj *state = getMgHttpMsgObj(this_val);
+    struct mg_connection *c = mgHttpMsgConn(state);
+    int status;
+    int encoding = -1;
+    const char *headers = NULL;
+    const char *headersStr = NULL;
+    char mem[512], *buf = mem;
+    if (JS_ToInt32(ctx, &status, argv[0]) != 0)
+        return JS_ThrowTypeError(ctx, "status code in not a number");
+    if (c == NULL || mgHttpMsgAnswered(state)) return JS_FALSE;
+    if (!mgHttpMsgInTurn(ctx, state, c)) return JS_EXCEPTION;
+    if (argc > 1)
+        headers = toExtraHeaders(ctx, argv[1], &headersStr);
+    mgCompressStreamFree(state->stream);
+    state->stream = NULL;
+    if ((argc < 3 || JS_ToBool(ctx, argv[2])) && mgHttpMsgMayCompress(state, c, headers, SIZE_MAX)) 
+    {
+        const mgCompressOpts *opts = mgMgrGetCompressOpts(c);
+        encoding = mgCompressNegotiate(
+            mg_http_get_header(state->msg, "Accept-Encoding"), opts->brotli);
+        if (encoding != MG_ENCODING_IDENTITY &&
+                (state->stream = mgCompressStreamNew(encoding, opts->level)) == NULL)
+            encoding = MG_ENCODING_IDENTITY;
+    }
+    withEncodingHeaders(headers, "Transfer-Encoding: chunked\r\n", encoding, &buf, sizeof(mem));
+    mg_http_write_head(c, status, buf);
+    state->started = true;
+    if (buf != mem) free(buf);
+    JS_FreeCString(ctx, headersStr);
+    return JS_TRUE;
 }
 
+// Writes a chunk, an empty one ends the response. Returns false if the
+// connection is gone or the response already ended.
 static JSValue mgHttpMsgHttpWrite(
     JSContext *ctx, JSValueConst this_val,
     int argc, JSValueConst *argv)
 {
     mgHttpMsgObj *state = getMgHttpMsgObj(this_val);
-    size_t len;
-    char *body = JS_ToCStringLen(ctx, &len, argv[0]);
-    mg_http_write_chunk(state->conn, body, len);
-    JS_FreeCString(ctx, body);
+    struct mg_connection *c = mgHttpMsgConn(state);
+    JSBytes body;
+    if (c == NULL || state->done) 
+    {
+        mgCompressStreamFree(state->stream);
+        state->stream = NULL;
+        return JS_FALSE;
+    }
+    if (!mgHttpMsgInTurn(ctx, state, c)) return JS_EXCEPTION;
+    if (JS_GetBytes(ctx, argv[0], &body) != 0)
+        return JS_EXCEPTION;
+    if (state->stream != NULL) 
+    {
+        struct mg_iobuf out = { NULL, 0, 0 };
+        bool finish = body.len == 0;
+        int ret = mgCompressStreamWrite(state->stream, body.ptr, body.len, finish, &out);
+        if (ret == 0 && out.len > 0)
+            mg_http_write_chunk(c, (const char *) out.buf, out.len);
+        mg_iobuf_free(&out);
+        if (finish || ret != 0) 
+        {
+            mgCompressStreamFree(state->stream);
+            state->stream = NULL;
+            mg_http_write_chunk(c, "", 0);
+            mgHttpMsgFinish(state, c);
+        }
+        JS_FreeBytes(ctx, &body);
+        if (ret != 0) return JS_ThrowInternalError(ctx, "compression failed");
+        return JS_TRUE;
+    }
+    mg_http_write_chunk(c, (const char *) body.ptr, body.len);
+    if (body.len == 0) mgHttpMsgFinish(state, c);
+    JS_FreeBytes(ctx, &body);
+    return JS_TRUE;
+}
+
+// Bytes of the response still waiting in the send buffer, or -1 once the
+// connection is gone
+static JSValue mgHttpMsgGetSendBuffered(JSContext *ctx, JSValueConst this_val)
+{
+    mgHttpMsgObj *state = getMgHttpMsgObj(this_val);
+    struct mg_connection *c = mgHttpMsgConn(state);
+    return JS_NewInt64(ctx, c == NULL ? -1 : (int64_t) c->send.len);
+}
+
+// Asks for an onHttpDrain call once the send buffer is down to watermark
+// bytes. Returns false if the connection is gone.
+static JSValue mgHttpMsgHttpWatchDrain(
+    JSContext *ctx, JSValueConst this_val,
+    int argc, JSValueConst *argv)
+{
+    mgHttpMsgObj *state = getMgHttpMsgObj(this_val);
+    struct mg_connection *c = mgHttpMsgConn(state);
+    int64_t watermark;
+    if (JS_ToInt64(ctx, &watermark, argv[0]) != 0)
+        return JS_EXCEPTION;
+    if (c == NULL) return JS_FALSE;
+    if (!mgMgrWatchDrain(c, watermark < 0 ? 0 : (size_t) watermark))
+        return JS_ThrowOutOfMemory(ctx);
+    return JS_TRUE;
+}
+
+// Ends a streamed response without its last chunk, so that the client
+// sees it as truncated rather than complete
+static JSValue mgHttpMsgHttpAbort(
+    JSContext *ctx, JSValueConst this_val,
+    int argc, JSValueConst *argv)
+{
+    mgHttpMsgObj *state = getMgHttpMsgObj(this_val);
+    struct mg_connection *c = mgHttpMsgConn(state);
+    mgCompressStreamFree(state->stream);
+    state->stream = NULL;
+    if (state->done) return JS_UNDEFINED; // The connection serves the next request
+    state->done = true;
+    if (c != NULL) c->is_draining = 1;
     return JS_UNDEFINED;
 }
 
+// cacheResponse(ttlMs, staleMs, vary): the reply to this GET request is
+// stored in the manager's response cache, if enabled, and served from
+// there for ttlMs, then for staleMs more while one request refreshes it.
+// vary lists the request headers, comma separated, that select a variant.
+static JSValue mgHttpMsgCacheResponse(
+    JSContext *ctx, JSValueConst this_val,
+    int argc, JSValueConst *argv)
+{
+    mgHttpMsgObj *state = getMgHttpMsgObj(this_val);
+    struct mg_connection *c = mgHttpMsgConn(state);
+    const mgCompressOpts *opts;
+    const char *vary = NULL;
+    char *buf = NULL;
+    int64_t ttl, swr = 0;
+    if (JS_ToInt64(ctx, &ttl, argv[0]) != 0 ||
+            (argc > 1 && JS_ToInt64(ctx, &swr, argv[1]) != 0))
+        return JS_EXCEPTION;
+    if (ttl <= 0 || c == NULL || state->msg == NULL || mgMgrGetRespCache(c) == NULL)
+        return JS_FALSE;
+    opts = mgMgrGetCompressOpts(c);
+    if (argc > 2 && !JS_IsUndefined(argv[2]) && !JS_IsNull(argv[2]) &&
+            (vary = JS_ToCString(ctx, argv[2])) == NULL)
+        return JS_EXCEPTION;
+    // Replies may be compressed according to Accept-Encoding
+    if (opts != NULL && opts->level > 0)
+        mg_asprintf(&buf, 0, "%s%sAccept-Encoding", vary ? vary : "", vary ? "," : "");
+    mgRespCachePolicyFree(state->cachePolicy);
+    state->cachePolicy = mgRespCachePolicyNew(state->msg,
+        (uint64_t) ttl, swr < 0 ? 0 : (uint64_t) swr, buf != NULL ? buf : vary);
+    free(buf);
+    JS_FreeCString(ctx, vary);
+    return JS_NewBool(ctx, state->cachePolicy != NULL);
+}
+
+// Answers with an event stream and moves the connection into the given
+// MongooseSseGroup. retryMs, if given, sets the client reconnection delay.
+static JSValue mgHttpMsgSseSubscribe(
+    JSContext *ctx, JSValueConst this_val,
+    int argc, JSValueConst *argv)
+{
+    mgHttpMsgObj *state = getMgHttpMsgObj(this_val);
+    struct mg_connection *c = mgHttpMsgConn(state);
+    const char *headers = NULL;
+    const char *headersStr = NULL;
+    char mem[512], *buf = mem;
+    int64_t retry = -1;
+    if (argc > 2 && !JS_IsUndefined(argv[2]) && !JS_IsNull(argv[2]) &&
+            JS_ToInt64(ctx, &retry, argv[2]) != 0)
+        return JS_EXCEPTION;
+    if (c == NULL || mgHttpMsgAnswered(state)) return JS_FALSE;
+    if (!mgHttpMsgInTurn(ctx, state, c)) return JS_EXCEPTION;
+    if (mgSseGroupAdd(ctx, argv[0], c) != 0)
+        return JS_EXCEPTION;
+    state->done = true;
+    if (argc > 1)
+        headers = toExtraHeaders(ctx, argv[1], &headersStr);
+    mg_asprintf(&buf, sizeof(mem),
+        "Content-Type: text/event-stream\r\nCache-Control: no-cache\r\n%s",
+        headers ? headers : "");
+    mg_http_write_head(c, 200, buf);
+    if (retry >= 0) mg_printf(c, "retry: %lld\n\n", (long long) retry);
+    if (buf != mem) free(buf);
+    JS_FreeCString(ctx, headersStr);
+    mgHttpMsgFinish(state, c);
+    return JS_TRUE;
+}
+
+// Whether the client's cached copy is still valid, given the response's
+// ETag and last modification time in milliseconds (or a Date)
+static JSValue mgHttpMsgIsFresh(
+    JSContext *ctx, JSValueConst this_val,
+    int argc, JSValueConst *argv)
+{
+    mgHttpMsgObj *state = getMgHttpMsgObj(this_val);
+    struct mg_http_message *msg = getMessage(ctx, state);
+    const char *etag = NULL;
+    double mtime = 0;
+    bool fresh;
+    if (msg == NULL) return JS_EXCEPTION;
+    if (argc > 1 && !JS_IsUndefined(argv[1]) && !JS_IsNull(argv[1]) &&
+            JS_ToFloat64(ctx, &mtime, argv[1]) != 0)
+        return JS_EXCEPTION;
+    if (argc > 0 && !JS_IsUndefined(argv[0]) && !JS_IsNull(argv[0]) &&
+            (etag = JS_ToCString(ctx, argv[0])) == NULL)
+        return JS_EXCEPTION;
+    fresh = mg_http_is_fresh(msg, etag, (time_t) (mtime / 1000));
+    JS_FreeCString(ctx, etag);
+    return JS_NewBool(ctx, fresh);
+}
+
 static struct mg_str *getHttpMessageStrProp(struct mg_http_message *msg, int prop) {
     switch (prop)
     {
@@ -150,8 +655,10 @@ static struct mg_str *getHttpMessageStrProp(struct mg_http_message *msg, int pro
 static JSValue mgHttpMsgGetProp(JSContext *ctx, JSValueConst this_val, int magic)
 {
     mgHttpMsgObj *state = getMgHttpMsgObj(this_val);
-    struct mg_http_message *msg = state->msg;
-    struct mg_str *prop = getHttpMessageStrProp(msg, magic);
+    struct mg_http_message *msg = getMessage(ctx, state);
+    struct mg_str *prop;
+    if (msg == NULL) return JS_EXCEPTION;
+    prop = getHttpMessageStrProp(msg, magic);
     if (prop == NULL) return JS_ThrowInternalError(ctx, "unknown property");
     return JS_NewStringLen(ctx, prop->ptr, prop->len);
 }
@@ -160,18 +667,7 @@ static JSValue mgHttpMsgGetHeaders(JSContext *ctx, JSValueConst this_val)
 {
     mgHttpMsgObj *state = getMgHttpMsgObj(this_val);
     if (JS_IsUndefined(state->jsHeaders)) 
-    {
-        struct mg_http_message *msg = state->msg;
-        state->jsHeaders = JS_NewObject(ctx);
-        for (int i = 0; i < MG_MAX_HTTP_HEADERS; i++) {
-            struct mg_http_header h = msg->headers[i];
-            if (h.name.ptr == NULL) break;
-            char name[h.name.len + 1];
-            JSValue val = JS_NewStringLen(ctx, h.value.ptr, h.value.len);
-            mg_str_to_cstr(&h.name, name, sizeof(name));
-            JS_SetPropertyStr(ctx, state->jsHeaders, name, val);
-        }
-    }
+        state->jsHeaders = mgHttpHeadersCreate(ctx, this_val);
     return JS_DupValue(ctx, state->jsHeaders);
 }
 
@@ -180,9 +676,11 @@ static JSValue mgHttpMsgGetHeaderValue(
     int argc, JSValueConst *argv)
 {
     mgHttpMsgObj *state = getMgHttpMsgObj(this_val);
-    struct mg_http_message *msg = state->msg;
-    char *name = JS_ToCString(ctx, argv[0]);
+    struct mg_http_message *msg = getMessage(ctx, state);
+    char *name;
     struct mg_str *val;
+    if (msg == NULL) return JS_EXCEPTION;
+    name = JS_ToCString(ctx, argv[0]);
     if (name == NULL)
         return JS_ThrowTypeError(ctx, "invalid header name");
     val = mg_http_get_header(msg, name);
@@ -190,12 +688,184 @@ static JSValue mgHttpMsgGetHeaderValue(
     return val == NULL ? JS_NULL : JS_NewStringLen(ctx, val->ptr, val->len);
 }
 
+// Walks the "name=value" pairs of a query string, decoding each name into
+// buf. Pairs whose name is empty or not valid percent-encoding are
+// skipped, "+" is decoded as a space.
+typedef struct {
+    const char *p, *end;
+    char *buf;
+    size_t bufSize;
+    int nameLen;
+    struct mg_str value;    // Still encoded, empty for keys without "="
+} mgQueryIter;
+
+static int mgQueryIterInit(JSContext *ctx, mgQueryIter *it, struct mg_str *query)
+{
+    it->p = query->ptr;
+    it->end = query->ptr + query->len;
+    it->bufSize = query->len + 1;
+    it->buf = js_malloc(ctx, it->bufSize);
+    return it->buf == NULL ? -1 : 0;
+}
+
+static bool mgQueryNext(mgQueryIter *it)
+{
+    while (it->p < it->end) {
+        const char *amp = memchr(it->p, '&', it->end - it->p), *eq;
+        if (amp == NULL) amp = it->end;
+        eq = memchr(it->p, '=', amp - it->p);
+        it->nameLen = mg_url_decode(it->p, (eq == NULL ? amp : eq) - it->p, it->buf, it->bufSize, 1);
+        it->value = eq == NULL ? mg_str_n(amp, 0) : mg_str_n(eq + 1, amp - eq - 1);
+        it->p = amp + 1;
+        if (it->nameLen > 0) return true;
+    }
+    return false;
+}
+
+// The decoded value, kept verbatim when it is not valid percent-encoding.
+// Overwrites the name in buf.
+static JSValue mgQueryDecodeValue(JSContext *ctx, mgQueryIter *it, struct mg_str value)
+{
+    int len = mg_url_decode(value.ptr, value.len, it->buf, it->bufSize, 1);
+    if (len < 0) return JS_NewStringLen(ctx, value.ptr, value.len);
+    return JS_NewStringLen(ctx, it->buf, len);
+}
+
+// Decodes the whole query string into a plain object. Keys without "=" map
+// to an empty string, and the last duplicate wins.
+static JSValue mgQueryToObject(JSContext *ctx, struct mg_str *query)
+{
+    JSValue obj = JS_NewObject(ctx);
+    mgQueryIter it;
+    if (query->len == 0) return obj;
+    if (mgQueryIterInit(ctx, &it, query) != 0) {
+        JS_FreeValue(ctx, obj);
+        return JS_EXCEPTION;
+    }
+    while (mgQueryNext(&it)) {
+        JSAtom key = JS_NewAtomLen(ctx, it.buf, it.nameLen);
+        if (key == JS_ATOM_NULL) {
+            js_free(ctx, it.buf);
+            JS_FreeValue(ctx, obj);
+            return JS_EXCEPTION;
+        }
+        JS_DefinePropertyValue(ctx, obj, key, mgQueryDecodeValue(ctx, &it, it.value), JS_PROP_C_W_E);
+        JS_FreeAtom(ctx, key);
+    }
+    js_free(ctx, it.buf);
+    return obj;
+}
+
+static JSValue mgHttpMsgGetQueryParams(JSContext *ctx, JSValueConst this_val)
+{
+    mgHttpMsgObj *state = getMgHttpMsgObj(this_val);
+    if (JS_IsUndefined(state->jsQueryParams)) 
+    {
+        JSValue params;
+        if (getMessage(ctx, state) == NULL) return JS_EXCEPTION;
+        params = mgQueryToObject(ctx, &state->msg->query);
+        if (JS_IsException(params)) return params;
+        state->jsQueryParams = params;
+    }
+    return JS_DupValue(ctx, state->jsQueryParams);
+}
+
+static JSValue mgHttpMsgLookupQueryParam(JSContext *ctx, JSValueConst this_val, JSValueConst name)
+{
+    JSValue params = mgHttpMsgGetQueryParams(ctx, this_val);
+    JSValue res = JS_UNDEFINED;
+    JSAtom key;
+    if (JS_IsException(params)) return params;
+    key = JS_ValueToAtom(ctx, name);
+    if (key != JS_ATOM_NULL) {
+        if (JS_GetOwnProperty(ctx, NULL, params, key) > 0)
+            res = JS_GetProperty(ctx, params, key);
+        JS_FreeAtom(ctx, key);
+    }
+    JS_FreeValue(ctx, params);
+    return res;
+}
+
+// The value of one query parameter, as mgQueryToObject() would give it
+static JSValue mgQueryFind(JSContext *ctx, struct mg_str *query, const char *name, size_t nameLen)
+{
+    mgQueryIter it;
+    struct mg_str value;
+    bool found = false;
+    JSValue res = JS_UNDEFINED;
+    if (mgQueryIterInit(ctx, &it, query) != 0) return JS_EXCEPTION;
+    while (mgQueryNext(&it)) {
+        if ((size_t) it.nameLen == nameLen && memcmp(it.buf, name, nameLen) == 0) {
+            found = true;
+            value = it.value;
+        }
+    }
+    if (found) res = mgQueryDecodeValue(ctx, &it, value);
+    js_free(ctx, it.buf);
+    return res;
+}
+
+static JSValue mgHttpMsgGetQueryParam(
+    JSContext *ctx, JSValueConst this_val,
+    int argc, JSValueConst *argv)
+{
+    mgHttpMsgObj *state = getMgHttpMsgObj(this_val);
+    struct mg_http_message *msg = getMessage(ctx, state);
+    struct mg_str *query;
+    if (msg == NULL) return JS_EXCEPTION;
+    query = &msg->query;
+    if (query->len == 0) return JS_UNDEFINED;
+    if (JS_IsUndefined(state->jsQueryParams) && !JS_IsSymbol(argv[0])) 
+    {
+        // Fast path: a single scan without materializing every parameter
+        size_t nameLen;
+        const char *name = JS_ToCStringLen(ctx, &nameLen, argv[0]);
+        JSValue res;
+        if (name == NULL)
+            return JS_ThrowTypeError(ctx, "invalid query parameter name");
+        res = mgQueryFind(ctx, query, name, nameLen);
+        JS_FreeCString(ctx, name);
+        return res;
+    }
+    return mgHttpMsgLookupQueryParam(ctx, this_val, argv[0]);
+}
+
+static JSValue mgHttpMsgGetResponseHeaders(JSContext *ctx, JSValueConst this_val)
+{
+    mgHttpMsgObj *state = getMgHttpMsgObj(this_val);
+    if (JS_IsUndefined(state->jsResponseHeaders)) 
+        state->jsResponseHeaders = mgRespHeadersCreate(ctx);
+    return JS_DupValue(ctx, state->jsResponseHeaders);
+}
+
 static JSValue mgHttpMsgGetConnection(JSContext *ctx, JSValueConst this_val)
 {
     mgHttpMsgObj *state = getMgHttpMsgObj(this_val);
-    if (JS_IsUndefined(state->jsConnection)) 
-        state->jsConnection = mgConnCreate(ctx, state->conn);
-    return JS_DupValue(ctx, state->jsConnection);
+    struct mg_connection *c = mgHttpMsgConn(state);
+    return mgConnGet(ctx, c);
+}
+
+static JSValue mgHttpMsgGetConnectionId(JSContext *ctx, JSValueConst this_val)
+{
+    mgHttpMsgObj *state = getMgHttpMsgObj(this_val);
+    return JS_NewInt64(ctx, (int64_t) state->connId);
+}
+
+// Whether the reply is complete. Until then, the request stays available
+// after its handler returns, and later requests on the connection wait.
+static JSValue mgHttpMsgGetDone(JSContext *ctx, JSValueConst this_val)
+{
+    mgHttpMsgObj *state = getMgHttpMsgObj(this_val);
+    return JS_NewBool(ctx, state->done);
+}
+
+// Whether the requests after this one have to wait: its reply is not
+// complete, or the file it serves is still being sent. Meant for batches,
+// during the event.
+static JSValue mgHttpMsgGetPending(JSContext *ctx, JSValueConst this_val)
+{
+    mgHttpMsgObj *state = getMgHttpMsgObj(this_val);
+    return JS_NewBool(ctx, !state->done || (state->inEvent && state->conn->is_paused));
 }
 
 static JSCFunctionListEntry mgHttpMsgClassFuncs[] = {
@@ -203,15 +873,28 @@ static JSCFunctionListEntry mgHttpMsgClassFuncs[] = {
     JS_CFUNC_MAGIC_DEF("httpServeFile", 1, mgHttpMsgHttpServe, 1),
     JS_CFUNC_DEF("wsUpgrade", 0, mgHttpMsgWsUpgrade),
     JS_CFUNC_DEF("httpReply", 3, mgHttpMsgHttpReply),
-    JS_CFUNC_DEF("httpWrite", 3, mgHttpMsgHttpWrite),
+    JS_CFUNC_DEF("httpWriteHead", 2, mgHttpMsgHttpWriteHead),
+    JS_CFUNC_DEF("httpWrite", 1, mgHttpMsgHttpWrite),
+    JS_CFUNC_DEF("httpWatchDrain", 1, mgHttpMsgHttpWatchDrain),
+    JS_CFUNC_DEF("httpAbort", 0, mgHttpMsgHttpAbort),
+    JS_CFUNC_DEF("sseSubscribe", 3, mgHttpMsgSseSubscribe),
+    JS_CFUNC_DEF("cacheResponse", 3, mgHttpMsgCacheResponse),
+    JS_CGETSET_DEF("sendBuffered", mgHttpMsgGetSendBuffered, NULL),
     JS_CFUNC_DEF("getHeaderValue", 1, mgHttpMsgGetHeaderValue),
+    JS_CFUNC_DEF("isFresh", 2, mgHttpMsgIsFresh),
+    JS_CFUNC_DEF("getQueryParam", 1, mgHttpMsgGetQueryParam),
     JS_CGETSET_MAGIC_DEF("uri", mgHttpMsgGetProp, NULL, MG_MSG_PROP_URI),
     JS_CGETSET_MAGIC_DEF("query", mgHttpMsgGetProp, NULL, MG_MSG_PROP_QUERY),
     JS_CGETSET_MAGIC_DEF("method", mgHttpMsgGetProp, NULL, MG_MSG_PROP_METHOD),
     JS_CGETSET_MAGIC_DEF("body", mgHttpMsgGetProp, NULL, MG_MSG_PROP_BODY),
     JS_CGETSET_MAGIC_DEF("message", mgHttpMsgGetProp, NULL, MG_MSG_PROP_MESSAGE),
     JS_CGETSET_DEF("headers", mgHttpMsgGetHeaders, NULL),
-    JS_CGETSET_DEF("connection", mgHttpMsgGetConnection, NULL)
+    JS_CGETSET_DEF("queryParams", mgHttpMsgGetQueryParams, NULL),
+    JS_CGETSET_DEF("responseHeaders", mgHttpMsgGetResponseHeaders, NULL),
+    JS_CGETSET_DEF("connection", mgHttpMsgGetConnection, NULL),
+    JS_CGETSET_DEF("connectionId", mgHttpMsgGetConnectionId, NULL),
+    JS_CGETSET_DEF("done", mgHttpMsgGetDone, NULL),
+    JS_CGETSET_DEF("pending", mgHttpMsgGetPending, NULL)
 };
 
 JSFullClassDef mgHttpMsgClass = {
@@ -3,8 +3,23 @@
 
 #include "mongoose.h"
 #include "js-utils.h"
+#include "object-pool.h"
 
 extern JSFullClassDef mgHttpMsgClass;
-JSValue mgHttpMsgCreate(JSContext *ctx, struct mg_connection *conn, struct mg_http_message *msg);
+// The native state comes from pool when not NULL, see mgHttpMsgPoolNew()
+JSValue mgHttpMsgCreate(JSContext *ctx, mgObjPool *pool, struct mg_connection *conn, struct mg_http_message *msg);
+mgObjPool *mgHttpMsgPoolNew(JSContext *ctx, size_t maxIdle);
+struct mg_http_message *mgHttpMsgGetMessage(JSValueConst obj);
+// Called when the event that created a message ends. A request whose reply
+// is still pending is copied, so that it can be answered later, and with
+// pause set the connection holds its next requests until then. Returns
+// whether the reply was pending.
+bool mgHttpMsgRelease(JSValueConst obj, bool pause);
+// Links a batched message to the one before it on the connection, it may
+// not reply until that one has. Lasts until the event ends.
+void mgHttpMsgSetPrevious(JSValueConst obj, JSValueConst prev);
+// Ends the event of a batched message whose request was left to be handed
+// over again: it can no longer be read or answered.
+void mgHttpMsgDrop(JSValueConst obj);
 
 #endif
\ No newline at end of file
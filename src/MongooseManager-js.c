@@ -4,6 +4,11 @@
 #include "MongooseHttpMessage-js.h"
 #include "MongooseWsMessage-js.h"
 #include "MongooseMqttClient-js.h"
+#include "MongooseMqttMessage-js.h"
+#include "MongooseSseGroup-js.h"
+#include "MongooseRouter-js.h"
+#include <math.h>
+#include <time.h>
 
 enum {
     MG_MGR_EVENT_HTTP_MESSAGE,
@@ -11,15 +16,80 @@ enum {
     MG_MGR_EVENT_WS_MESSAGE,
     MG_MGR_EVENT_WS_OPEN,
     MG_MGR_EVENT_SNTP_MESSAGE,
+    MG_MGR_EVENT_HTTP_BATCH,
+    MG_MGR_EVENT_HTTP_DRAIN,
+    MG_MGR_EVENT_BATCH,
     MG_MGR_EVENT_MAX,
 };
 
+// Upper bound of pipelined requests handed to onHttpBatch in one call
+#define MG_MGR_MAX_BATCH 32
+// Idle native message states kept for reuse, see messagePoolSize
+#define MG_MGR_DEFAULT_MSG_POOL 64
+
+// Upper bounds in microseconds of the gcStats pause histogram, the last
+// bucket takes the longer pauses
+static const uint32_t mgMgrGcBuckets[] = {
+    100, 250, 500, 1000, 2000, 5000, 10000, 25000, 50000, 100000
+};
+#define MG_MGR_GC_BUCKETS (sizeof(mgMgrGcBuckets) / sizeof(mgMgrGcBuckets[0]) + 1)
+
+typedef struct mgMgrListener mgMgrListener;
+typedef struct mgMgrDrainWatch mgMgrDrainWatch;
+
+// Collections run by gc() and by idle polls, see enableIdleGc. The ones
+// QuickJS starts by itself on reaching gcThreshold are not timed.
+typedef struct {
+    uint64_t idleUs;            // Quiet time before a collection, 0 when off
+    uint64_t lastBusyUs;
+    uint64_t events;            // Events emitted so far
+    uint64_t eventsAtGc;
+    size_t threshold;           // As set through gcThreshold, 0 when unset
+    int64_t memoryLimit;
+    uint64_t count, idleCount;
+    uint64_t totalUs, maxUs, lastUs;
+    uint64_t histogram[MG_MGR_GC_BUCKETS];
+} mgMgrGcState;
+
 typedef struct {
     JSContext *ctx;
     struct mg_mgr mgr;
     JSValue events[MG_MGR_EVENT_MAX];
+    mgMgrListener *listeners;
+    mgMgrDrainWatch *drainWatches;
+    mgRespCache *respCache;
+    struct mg_http_message *batch;
+    mgObjPool *httpMsgPool;
+    mgObjPool *wsMsgPool;
+    mgConnMap conns;
+    JSValue eventBatch;         // Reused by every poll, see onEventBatch
+    uint32_t eventBatchLen;
+    bool polling;
+    bool failed;                // A callback threw, see mgMgrCatch()
+    JSValue error;              // The first exception thrown
+    mgMgrGcState gc;
 } mgMgrObj;
 
+// Per httpListen() settings, passed as fn_data to the listening connection
+// and inherited by every connection it accepts. A limit of 0 means that only
+// the compile-time MG_MAX_* limits apply.
+struct mgMgrListener {
+    mgMgrListener *next;
+    mgMgrObj *mgr;
+    uint64_t maxHeaderBytes;
+    uint64_t maxHeaders;
+    uint64_t maxBodyBytes;
+    bool batchPipelined;
+    mgCompressOpts compress;
+};
+
+// A streamed response waiting for its connection's send buffer to drain
+struct mgMgrDrainWatch {
+    mgMgrDrainWatch *next;
+    unsigned long connId;
+    size_t watermark;
+};
+
 static mgMgrObj* getMgMgrObj(JSValueConst this_val) 
 {
     return JS_GetOpaque(this_val, mgMgrClass.id);
@@ -35,61 +105,524 @@ static JSValue mgMgrContructor(
     state->ctx = ctx;
     for (int i = 0 ; i < MG_MGR_EVENT_MAX; i++) 
         state->events[i] = JS_UNDEFINED;
+    state->eventBatch = JS_UNDEFINED;
+    state->error = JS_UNDEFINED;
+    // Out of memory, a NULL pool only means every message allocates its state
+    state->httpMsgPool = mgHttpMsgPoolNew(ctx, MG_MGR_DEFAULT_MSG_POOL);
+    state->wsMsgPool = mgWsMsgPoolNew(ctx, MG_MGR_DEFAULT_MSG_POOL);
     mg_mgr_init(&state->mgr);
     JS_SetOpaque(obj, state);
     return obj;
 }
 
+static mgMgrObj *mgMgrOf(struct mg_mgr *mgr)
+{
+    // Every mg_mgr of the bindings is embedded in a manager
+    return (mgMgrObj *) ((char *) mgr - offsetof(mgMgrObj, mgr));
+}
+
+mgConnMap *mgMgrGetConnMap(struct mg_mgr *mgr)
+{
+    return &mgMgrOf(mgr)->conns;
+}
+
+// Event arguments borrowing mongoose buffers are copied before they are
+// queued, and detached from them once their callback returned. Requests
+// not answered by then are kept, and hold the next ones on their
+// connection.
+static void mgMgrPinEventArg(JSValueConst arg)
+{
+    mgHttpMsgRelease(arg, true);
+    mgWsMsgPin(arg);
+    mgMqttMsgPin(arg);
+}
+
+static void mgMgrReleaseEventArg(JSValueConst arg)
+{
+    mgHttpMsgRelease(arg, true);
+    mgWsMsgRelease(arg);
+    mgMqttMsgRelease(arg);
+}
+
+// Takes the result of a callback over. A callback that throws does not
+// hold back the others: the first error is kept, and poll() throws it once
+// all the events of the poll ran. Errors of events emitted outside a poll
+// are thrown by the next one.
+static void mgMgrCatch(mgMgrObj *state, JSValue res)
+{
+    JSContext *ctx = state->ctx;
+    if (JS_IsException(res)) 
+    {
+        JSValue e = JS_GetException(ctx);
+        if (state->failed) 
+            JS_FreeValue(ctx, e);
+        else
+            state->error = e;
+        state->failed = true;
+    }
+    JS_FreeValue(ctx, res);
+}
+
+// Calls fn with arg, or queues the call for onEventBatch when it is set
+// and the event comes from poll(). Takes arg over.
+static void mgMgrEmitEvent(mgMgrObj *state, JSValueConst fn, JSValue arg)
+{
+    JSContext *ctx = state->ctx;
+    if (!JS_IsFunction(ctx, fn)) 
+    {
+        mgMgrReleaseEventArg(arg);
+        JS_FreeValue(ctx, arg);
+        return;
+    }
+    state->gc.events++;
+    if (state->polling && JS_IsFunction(ctx, state->events[MG_MGR_EVENT_BATCH])) 
+    {
+        if (JS_IsUndefined(state->eventBatch))
+            state->eventBatch = JS_NewArray(ctx);
+        mgMgrPinEventArg(arg);
+        JS_SetPropertyUint32(ctx, state->eventBatch, state->eventBatchLen++, JS_DupValue(ctx, fn));
+        JS_SetPropertyUint32(ctx, state->eventBatch, state->eventBatchLen++, arg);
+        return;
+    }
+    mgMgrCatch(state, JS_Call(ctx, fn, JS_UNDEFINED, 1, &arg));
+    mgMgrReleaseEventArg(arg);
+    JS_FreeValue(ctx, arg);
+}
+
+void mgMgrEmit(struct mg_mgr *mgr, JSValueConst fn, JSValue arg)
+{
+    mgMgrEmitEvent(mgMgrOf(mgr), fn, arg);
+}
+
+// One call of onEventBatch(events, count) for every event queued by the
+// poll, events holding count callbacks and arguments in turn. The entries
+// are cleared afterwards, so that the array keeps its storage.
+static void mgMgrDispatchEvents(mgMgrObj *state)
+{
+    JSContext *ctx = state->ctx;
+    JSValue fn = state->events[MG_MGR_EVENT_BATCH];
+    JSValue args[2];
+    uint32_t len = state->eventBatchLen;
+    if (len == 0) return;
+    if (JS_IsFunction(ctx, fn)) 
+    {
+        args[0] = state->eventBatch;
+        args[1] = JS_NewUint32(ctx, len);
+        mgMgrCatch(state, JS_Call(ctx, fn, JS_UNDEFINED, 2, args));
+    }
+    else 
+    {
+        // Unset by a callback of the same poll
+        for (uint32_t i = 0; i < len; i += 2) 
+        {
+            JSValue cb = JS_GetPropertyUint32(ctx, state->eventBatch, i);
+            JSValue arg = JS_GetPropertyUint32(ctx, state->eventBatch, i + 1);
+            mgMgrCatch(state, JS_Call(ctx, cb, JS_UNDEFINED, 1, &arg));
+            JS_FreeValue(ctx, cb);
+            JS_FreeValue(ctx, arg);
+        }
+    }
+    state->eventBatchLen = 0;
+    for (uint32_t i = 0; i < len; i += 2) 
+    {
+        JSValue arg = JS_GetPropertyUint32(ctx, state->eventBatch, i + 1);
+        mgMgrReleaseEventArg(arg);
+        JS_FreeValue(ctx, arg);
+        JS_SetPropertyUint32(ctx, state->eventBatch, i, JS_UNDEFINED);
+        JS_SetPropertyUint32(ctx, state->eventBatch, i + 1, JS_UNDEFINED);
+    }
+}
+
+const mgCompressOpts *mgMgrGetCompressOpts(struct mg_connection *c)
+{
+    mgMgrListener *lsn = c->fn_data;
+    return lsn == NULL ? NULL : &lsn->compress;
+}
+
+mgRespCache *mgMgrGetRespCache(struct mg_connection *c)
+{
+    mgMgrListener *lsn = c->fn_data;
+    return lsn == NULL ? NULL : lsn->mgr->respCache;
+}
+
+bool mgMgrWatchDrain(struct mg_connection *c, size_t watermark)
+{
+    mgMgrListener *lsn = c->fn_data;
+    mgMgrObj *state = lsn->mgr;
+    mgMgrDrainWatch *w;
+    for (w = state->drainWatches; w != NULL; w = w->next)
+        if (w->connId == c->id) break;
+    if (w == NULL) 
+    {
+        if ((w = js_malloc(state->ctx, sizeof(*w))) == NULL) return false;
+        w->connId = c->id;
+        w->next = state->drainWatches;
+        state->drainWatches = w;
+    }
+    w->watermark = watermark;
+    return true;
+}
+
+// Drops the watch of a connection. Returns whether it had one and, if
+// drained is set, only when the send buffer is down to its watermark.
+static bool mgMgrUnwatchDrain(mgMgrObj *state, struct mg_connection *c, bool drained)
+{
+    mgMgrDrainWatch **p, *w;
+    for (p = &state->drainWatches; (w = *p) != NULL; p = &w->next) 
+    {
+        if (w->connId != c->id) continue;
+        if (drained && c->send.len > w->watermark) return false;
+        *p = w->next;
+        js_free(state->ctx, w);
+        return true;
+    }
+    return false;
+}
+
+static bool mgMgrHasLimits(mgMgrListener *lsn)
+{
+    return lsn->maxHeaderBytes > 0 || lsn->maxHeaders > 0 || lsn->maxBodyBytes > 0;
+}
+
+static size_t countHeaderLines(const unsigned char *head, size_t len)
+{
+    size_t lines = 0;
+    for (size_t i = 0; i < len; i++)
+        if (head[i] == '\n') lines++;
+    // Do not count the request line and the empty line ending the head
+    return lines > 2 ? lines - 2 : 0;
+}
+
+// Body bytes announced by the chunks in buf: those received and the rest of
+// the chunk being received. Bytes after the last chunk belong to the next
+// requests.
+static size_t chunkedBodyLen(const char *buf, size_t len)
+{
+    size_t total = 0, i = 0;
+    while (i < len) 
+    {
+        size_t start = i, size;
+        while (i < len && isxdigit((unsigned char) buf[i])) i++;
+        if (i - start > 2 * sizeof(size_t) - 1) return SIZE_MAX;
+        size = (size_t) mg_unhexn(buf + start, i - start);
+        while (i < len && buf[i] != '\n') i++; // Extensions and CR
+        if (i >= len || size == 0) break;       // Size line incomplete, or last chunk
+        if (size > SIZE_MAX - total) return SIZE_MAX;
+        total += size;
+        if (size > len - i) break;
+        i += 1 + size + 2;                      // LF, data, CRLF
+    }
+    return total;
+}
+
+// Returns the status code the request at the start of c->recv must be
+// rejected with, or 0 if it is within the listener limits. Runs before
+// http_cb(), so the head is checked as soon as it has been received.
+static int mgMgrCheckLimits(mgMgrListener *lsn, struct mg_connection *c)
+{
+    struct mg_http_message hm;
+    struct mg_str *te;
+    int n = mg_http_get_request_len(c->recv.buf, c->recv.len);
+    if (n < 0) return 0; // Malformed, http_cb() reports the error
+    if (n == 0)
+        return lsn->maxHeaderBytes > 0 && c->recv.len > lsn->maxHeaderBytes ? 431 : 0;
+    if (lsn->maxHeaderBytes > 0 && (size_t) n > lsn->maxHeaderBytes)
+        return 431;
+    if (lsn->maxHeaders > 0 && countHeaderLines(c->recv.buf, n) > lsn->maxHeaders)
+        return 431;
+    if (lsn->maxBodyBytes > 0 && mg_http_parse((char *) c->recv.buf, c->recv.len, &hm) > 0) {
+        size_t body, decoded;
+        te = mg_http_get_header(&hm, "Transfer-Encoding");
+        if (te == NULL && hm.body.len != (size_t) ~0)
+            body = hm.body.len;
+        else if (te != NULL && mg_vcasecmp(te, "chunked") == 0) 
+        {
+            // http_cb() compacts the chunks decoded so far right after the
+            // head, and keeps their length in pfn_data until the body is
+            // complete. Nothing is decoded while the connection is paused.
+            decoded = c->is_paused ? 0 : (size_t) c->pfn_data;
+            if (decoded > c->recv.len - n) decoded = 0;
+            body = decoded + chunkedBodyLen((const char *) c->recv.buf + n + decoded,
+                c->recv.len - n - decoded);
+        }
+        else
+            body = c->recv.len - n; // Read until the connection closes
+        if (body > lsn->maxBodyBytes)
+            return 413;
+    }
+    return 0;
+}
+
+// Same limits for a complete request about to be dispatched. Requests
+// arriving in one read behind the first one are only checked here.
+static int mgMgrCheckMessage(mgMgrListener *lsn, struct mg_http_message *hm)
+{
+    if (lsn->maxHeaderBytes > 0 && hm->head.len > lsn->maxHeaderBytes)
+        return 431;
+    if (lsn->maxHeaders > 0 &&
+            countHeaderLines((const unsigned char *) hm->head.ptr, hm->head.len) > lsn->maxHeaders)
+        return 431;
+    if (lsn->maxBodyBytes > 0 && hm->body.len > lsn->maxBodyBytes)
+        return 413;
+    return 0;
+}
+
+static void mgMgrRejectRequest(struct mg_connection *c, int status)
+{
+    const char *reason = status == 413 ? "Payload Too Large" : "Request Header Fields Too Large";
+    mg_http_reply(c, status, "Connection: close\r\n", "%s\n", reason);
+    mg_iobuf_free(&c->recv); // Nothing is left for http_cb() to parse
+    c->is_full = 1;          // Stop reading from the socket
+    c->is_draining = 1;      // Close once the reply is sent
+}
+
+// Batch mode: every complete request already buffered on the connection
+// is handed to onHttpBatch in a single call, and their replies are
+// appended to c->send in order, to be flushed together by the next poll.
+// Chunked and upgrade requests, and all requests after them, are left to
+// the regular http_cb() path. A message may only reply once the ones before
+// it have, and the first one left pending holds the connection like in
+// http_cb(): the requests after it stay buffered, to be handed over again.
+static void mgMgrDispatchBatch(mgMgrObj *state, mgMgrListener *lsn, struct mg_connection *c)
+{
+    JSContext *ctx = state->ctx;
+    JSValue fn = state->events[MG_MGR_EVENT_HTTP_BATCH];
+    JSValue msgs, objs[MG_MGR_MAX_BATCH];
+    size_t off = 0, consumed = 0;
+    bool held = false;
+    int count = 0;
+    if (!JS_IsFunction(ctx, fn)) return;
+    if (state->batch == NULL) 
+    {
+        state->batch = js_malloc(ctx, sizeof(*state->batch) * MG_MGR_MAX_BATCH);
+        if (state->batch == NULL) return;
+    }
+    while (count < MG_MGR_MAX_BATCH && off < c->recv.len) 
+    {
+        struct mg_http_message *hm = &state->batch[count];
+        int n = mg_http_parse((char *) c->recv.buf + off, c->recv.len - off, hm);
+        if (n <= 0 || hm->message.len > c->recv.len - off) break;
+        if (mg_http_get_header(hm, "Transfer-Encoding") != NULL ||
+            mg_http_get_header(hm, "Upgrade") != NULL) break;
+        // Over the limits: http_cb() dispatches the requests before it and
+        // then rejects this one
+        if (mgMgrHasLimits(lsn) && mgMgrCheckMessage(lsn, hm) != 0) break;
+        if (state->respCache != NULL) 
+        {
+            // Cache hits are answered without entering JS. Past the first
+            // batched request, this would come before the replies of the
+            // batch: the batch ends there and http_cb() serves the hit.
+            if (count == 0 && mgRespCacheServe(state->respCache, c, hm)) 
+            {
+                off += hm->message.len;
+                consumed = off;
+                continue;
+            }
+            if (count > 0 && mgRespCacheHas(state->respCache, hm)) break;
+        }
+        off += hm->message.len;
+        count++;
+    }
+    if (count < 2) 
+    {
+        // Nothing pipelined, http_cb() handles the rest
+        mg_iobuf_del(&c->recv, 0, consumed);
+        return;
+    }
+    state->gc.events++;
+    msgs = JS_NewArray(ctx);
+    for (int i = 0; i < count; i++) 
+    {
+        objs[i] = mgHttpMsgCreate(ctx, state->httpMsgPool, c, &state->batch[i]);
+        if (i > 0) mgHttpMsgSetPrevious(objs[i], objs[i - 1]);
+        JS_SetPropertyUint32(ctx, msgs, i, JS_DupValue(ctx, objs[i]));
+    }
+    mgMgrCatch(state, JS_Call(ctx, fn, JS_UNDEFINED, 1, &msgs));
+    JS_FreeValue(ctx, msgs);
+    for (int i = 0; i < count; i++) 
+    {
+        if (held)
+            mgHttpMsgDrop(objs[i]);
+        else 
+        {
+            consumed += state->batch[i].message.len;
+            held = mgHttpMsgRelease(objs[i], true) || c->is_paused;
+        }
+        JS_FreeValue(ctx, objs[i]);
+    }
+    mg_iobuf_del(&c->recv, 0, consumed);
+}
+
 static void mgMgrHttpCallback(struct mg_connection *c, int ev, void *ev_data, void *fn_data) 
 {
-    mgMgrObj *state = fn_data;
-    if (ev == MG_EV_HTTP_MSG) 
+    mgMgrListener *lsn = fn_data;
+    mgMgrObj *state = lsn->mgr;
+    if (ev == MG_EV_OPEN)
+        mgConnOpened(c);
+    else if (ev == MG_EV_POLL && c->is_resuming) 
+    {
+        // A deferred reply completed, see mgHttpMsgFinish()
+        c->is_resuming = 0;
+        if (!c->is_closing && !c->is_draining) mg_http_resume(c);
+    }
+    else if (ev == MG_EV_READ && !c->is_websocket) 
+    {
+        int status = 0;
+        if (mgMgrHasLimits(lsn) && (status = mgMgrCheckLimits(lsn, c)) != 0)
+            mgMgrRejectRequest(c, status);
+        else if (lsn->batchPipelined && !c->is_paused)
+            mgMgrDispatchBatch(state, lsn, c);
+    }
+    else if (ev == MG_EV_WRITE && state->drainWatches != NULL) 
+    {
+        JSValue fn = state->events[MG_MGR_EVENT_HTTP_DRAIN];
+        if (mgMgrUnwatchDrain(state, c, true))
+            mgMgrEmitEvent(state, fn, JS_NewInt64(state->ctx, (int64_t) c->id));
+    }
+    else if (ev == MG_EV_HTTP_MSG) 
     {
         struct mg_http_message *hm = (struct mg_http_message *) ev_data;
-        JSValue fn = state->events[MG_MGR_EVENT_HTTP_MESSAGE];
-        JSValue msgObj = mgHttpMsgCreate(state->ctx, c, hm);
-        if (JS_IsFunction(state->ctx, fn))
-            JS_Call(state->ctx, fn, JS_UNDEFINED, 1, &msgObj);
-        JS_FreeValue(state->ctx, msgObj);
+        int status;
+        if (mgMgrHasLimits(lsn) && (status = mgMgrCheckMessage(lsn, hm)) != 0) 
+        {
+            mgMgrRejectRequest(c, status);
+            return;
+        }
+        // Cache hits are answered without entering JS
+        if (state->respCache != NULL && mgRespCacheServe(state->respCache, c, hm))
+            return;
+        // A handler that has not replied yet, e.g. awaiting a promise, keeps
+        // the request and holds the next ones on this connection
+        mgMgrEmitEvent(state, state->events[MG_MGR_EVENT_HTTP_MESSAGE],
+            mgHttpMsgCreate(state->ctx, state->httpMsgPool, c, hm));
     } 
     else if (ev == MG_EV_WS_OPEN) 
     {
-        JSValue fn = state->events[MG_MGR_EVENT_WS_OPEN];
-        JSValue connObj = mgConnCreate(state->ctx, c); 
-        if (JS_IsFunction(state->ctx, fn))
-            JS_Call(state->ctx, fn, JS_UNDEFINED, 1, &connObj);
-        JS_FreeValue(state->ctx, connObj);
+        mgMgrEmitEvent(state, state->events[MG_MGR_EVENT_WS_OPEN], mgConnGet(state->ctx, c));
     }
     else if (ev == MG_EV_WS_MSG) 
     {
         struct mg_ws_message *wm = (struct mg_ws_message *) ev_data;
-        JSValue fn = state->events[MG_MGR_EVENT_WS_MESSAGE];
-        JSValue msgObj = mgWsMsgCreate(state->ctx, c, wm); 
-        if (JS_IsFunction(state->ctx, fn))
-            JS_Call(state->ctx, fn, JS_UNDEFINED, 1, &msgObj);
-        JS_FreeValue(state->ctx, msgObj);
+        mgMgrEmitEvent(state, state->events[MG_MGR_EVENT_WS_MESSAGE],
+            mgWsMsgCreate(state->ctx, state->wsMsgPool, c, wm));
     }
     else if (ev == MG_EV_CLOSE) 
     {
-        JSValue fn = state->events[MG_MGR_EVENT_HTTP_CLOSE];
-        JSValue connObj = mgConnCreate(state->ctx, c); 
-        if (JS_IsFunction(state->ctx, fn))
-            JS_Call(state->ctx, fn, JS_UNDEFINED, 1, &connObj);
-        JS_FreeValue(state->ctx, connObj);
+        mgMgrUnwatchDrain(state, c, false);
+        mgMgrEmitEvent(state, state->events[MG_MGR_EVENT_HTTP_CLOSE], mgConnGet(state->ctx, c));
+        mgConnClosed(state->ctx, c);
     }
 }
 
+// Compression is off unless "compress" is set, "compressLevel" (1-9, or
+// up to 11 for brotli) and "compressMinSize" fine tune it
+static int mgMgrGetCompressOptions(JSContext *ctx, JSValueConst opts, mgCompressOpts *res)
+{
+    uint64_t level = MG_COMPRESS_DEFAULT_LEVEL;
+    uint64_t minSize = MG_COMPRESS_DEFAULT_MIN_SIZE;
+    JSValue val;
+    if (!JS_IsObject(opts)) return 0;
+    val = JS_GetPropertyStr(ctx, opts, "compress");
+    bool enabled = JS_ToBool(ctx, val);
+    JS_FreeValue(ctx, val);
+    if (!enabled) return 0;
+    if (JS_GetOptionalIndexProp(ctx, opts, "compressLevel", &level) ||
+        JS_GetOptionalIndexProp(ctx, opts, "compressMinSize", &minSize))
+        return -1;
+    val = JS_GetPropertyStr(ctx, opts, "brotli");
+    res->brotli = JS_IsUndefined(val) || JS_ToBool(ctx, val);
+    JS_FreeValue(ctx, val);
+    res->level = level > 11 ? 11 : (int) level;
+    res->minSize = minSize;
+    return 0;
+}
+
 static JSValue mgMgrHttpListen(
     JSContext *ctx, JSValueConst this_val,
     int argc, JSValueConst *argv)
 {
     mgMgrObj *state = getMgMgrObj(this_val);
-    const char *url = JS_ToCString(ctx, argv[0]);
-    mg_http_listen(&state->mgr, url, mgMgrHttpCallback, state);
+    mgMgrListener *lsn = js_mallocz(ctx, sizeof(*lsn));
+    const char *url;
+    if (lsn == NULL) return JS_EXCEPTION;
+    lsn->mgr = state;
+    if (argc > 1 && JS_IsObject(argv[1])) 
+    {
+        JSValue batch = JS_GetPropertyStr(ctx, argv[1], "batchPipelined");
+        lsn->batchPipelined = JS_ToBool(ctx, batch);
+        JS_FreeValue(ctx, batch);
+    }
+    if (argc > 1 && (
+            JS_GetOptionalIndexProp(ctx, argv[1], "maxHeaderBytes", &lsn->maxHeaderBytes) ||
+            JS_GetOptionalIndexProp(ctx, argv[1], "maxHeaders", &lsn->maxHeaders) ||
+            JS_GetOptionalIndexProp(ctx, argv[1], "maxBodyBytes", &lsn->maxBodyBytes) ||
+            mgMgrGetCompressOptions(ctx, argv[1], &lsn->compress))) 
+    {
+        js_free(ctx, lsn);
+        return JS_EXCEPTION;
+    }
+    // Mongoose closes a connection whose receive buffer reaches that size,
+    // before a 413 could be sent
+    if (lsn->maxBodyBytes > MG_MAX_RECV_BUF_SIZE) 
+    {
+        js_free(ctx, lsn);
+        return JS_ThrowRangeError(ctx, "maxBodyBytes must not exceed %d", MG_MAX_RECV_BUF_SIZE);
+    }
+    url = JS_ToCString(ctx, argv[0]);
+    if (url == NULL || mg_http_listen(&state->mgr, url, mgMgrHttpCallback, lsn) == NULL) 
+    {
+        JS_FreeCString(ctx, url);
+        js_free(ctx, lsn);
+        return JS_ThrowInternalError(ctx, "cannot listen on the given url");
+    }
+    lsn->next = state->listeners;
+    state->listeners = lsn;
     JS_FreeCString(ctx, url);
     return JS_UNDEFINED;
 }
 
+static uint64_t mgMgrMicros(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000 + (uint64_t) ts.tv_nsec / 1000;
+}
+
+// Runs a full collection and records its pause, in microseconds
+static uint64_t mgMgrRunGc(mgMgrObj *state, bool idle)
+{
+    JSRuntime *rt = JS_GetRuntime(state->ctx);
+    mgMgrGcState *gc = &state->gc;
+    uint64_t start = mgMgrMicros(), pause;
+    size_t bucket = 0;
+    JS_RunGC(rt);
+    pause = mgMgrMicros() - start;
+    while (bucket < MG_MGR_GC_BUCKETS - 1 && pause > mgMgrGcBuckets[bucket]) bucket++;
+    gc->histogram[bucket]++;
+    gc->count++;
+    if (idle) gc->idleCount++;
+    gc->totalUs += pause;
+    gc->lastUs = pause;
+    if (pause > gc->maxUs) gc->maxUs = pause;
+    gc->eventsAtGc = gc->events;
+    // An automatic collection lowers the threshold to 1.5 times the heap
+    // it left, which would bring the next ones back into bursts
+    if (gc->threshold > 0) JS_SetGCThreshold(rt, gc->threshold);
+    return pause;
+}
+
+// Collects once the server has been quiet for idleUs after running JS, so
+// that the pause falls between bursts of events rather than inside one
+static void mgMgrIdleGc(mgMgrObj *state, bool busy)
+{
+    uint64_t now = mgMgrMicros();
+    if (busy)
+        state->gc.lastBusyUs = now;
+    else if (state->gc.events != state->gc.eventsAtGc &&
+            now - state->gc.lastBusyUs >= state->gc.idleUs)
+        mgMgrRunGc(state, true);
+}
+
 static JSValue mgMgrPoll(
     JSContext *ctx, JSValueConst this_val,
     int argc, JSValueConst *argv)
@@ -98,18 +631,31 @@ static JSValue mgMgrPoll(
     int ms;
     if (JS_ToInt32(ctx, &ms, argv[0]) != 0)
         return JS_ThrowTypeError(ctx, "The ms value should be an integer");
+    uint64_t events = state->gc.events;
+    state->polling = true;
     mg_mgr_poll(&state->mgr, ms);
+    state->polling = false;
+    mgMgrDispatchEvents(state);
+    if (state->gc.idleUs > 0) mgMgrIdleGc(state, state->gc.events != events);
+    if (state->failed) 
+    {
+        JSValue error = state->error;
+        state->failed = false;
+        state->error = JS_UNDEFINED;
+        return JS_Throw(ctx, error);
+    }
     return JS_UNDEFINED;
 }
 
 static void mgMgrSntpCb(struct mg_connection *c, int ev, void *evd, void *fnd) {
   mgMgrObj *state = fnd;
-  if (ev == MG_EV_SNTP_TIME) {
+  if (ev == MG_EV_OPEN) {
+    mgConnOpened(c);
+  } else if (ev == MG_EV_CLOSE) {
+    mgConnClosed(state->ctx, c);
+  } else if (ev == MG_EV_SNTP_TIME) {
     int64_t t = *(int64_t *) evd;
-    JSValue fn = state->events[MG_MGR_EVENT_SNTP_MESSAGE];
-    JSValue secs = JS_NewInt64(state->ctx, t);
-    if (JS_IsFunction(state->ctx, fn))
-      JS_Call(state->ctx, fn, JS_UNDEFINED, 1, &secs);
+    mgMgrEmitEvent(state, state->events[MG_MGR_EVENT_SNTP_MESSAGE], JS_NewInt64(state->ctx, t));
   }
 }
 
@@ -120,7 +666,7 @@ static JSValue mgMgrSntpConnect(
     mgMgrObj *state = getMgMgrObj(this_val);
     struct mg_connection *c = mg_sntp_connect(
         &state->mgr, NULL /* connect to time.google.com */, mgMgrSntpCb, state);
-    return mgConnCreate(ctx, c);
+    return mgConnGet(ctx, c);
 }
 
 static JSValue mgMgrEventGet(
@@ -146,7 +692,24 @@ static JSValue mgMgrEventSet(
 static void mgMgrFinalizer(JSRuntime *rt, JSValue val) 
 {
     mgMgrObj *state = getMgMgrObj(val);
+    mgMgrListener *lsn, *next;
+    mgMgrDrainWatch *w, *nextWatch;
     mg_mgr_free(&state->mgr);
+    mgConnMapFree(&state->conns);
+    for (lsn = state->listeners; lsn != NULL; lsn = next) {
+        next = lsn->next;
+        js_free(state->ctx, lsn);
+    }
+    for (w = state->drainWatches; w != NULL; w = nextWatch) {
+        nextWatch = w->next;
+        js_free(state->ctx, w);
+    }
+    js_free(state->ctx, state->batch);
+    JS_FreeValueRT(rt, state->eventBatch);
+    JS_FreeValueRT(rt, state->error);
+    mgRespCacheFree(state->respCache);
+    mgObjPoolRelease(state->httpMsgPool);
+    mgObjPoolRelease(state->wsMsgPool);
     for (int i = 0 ; i < MG_MGR_EVENT_MAX; i++)
         JS_FreeValueRT(rt, state->events[i]);
     js_free(state->ctx, state);
@@ -159,7 +722,282 @@ static void mgMgrGcMark(JSRuntime *rt, JSValueConst val, JS_MarkFunc *mark_func)
     {
         for (int i = 0 ; i < MG_MGR_EVENT_MAX; i++)
             JS_MarkValue(rt, state->events[i], mark_func);
+        JS_MarkValue(rt, state->eventBatch, mark_func);
+        JS_MarkValue(rt, state->error, mark_func);
+    }
+}
+
+static JSValue mgMgrServerHeaderGet(
+    JSContext *ctx, JSValueConst this_val)
+{
+    mgMgrObj *state = getMgMgrObj(this_val);
+    const char *hdr = state->mgr.http_server;
+    // Stored as "Server: <name>\r\n"
+    if (hdr == NULL) return JS_NULL;
+    return JS_NewStringLen(ctx, hdr + 8, strlen(hdr) - 10);
+}
+
+static JSValue mgMgrServerHeaderSet(
+    JSContext *ctx, JSValueConst this_val, JSValueConst value)
+{
+    mgMgrObj *state = getMgMgrObj(this_val);
+    if (JS_IsNull(value) || JS_IsUndefined(value)) {
+        mg_http_set_server(&state->mgr, NULL);
+        return JS_UNDEFINED;
     }
+    const char *name = JS_ToCString(ctx, value);
+    if (!name) return JS_EXCEPTION;
+    if (strpbrk(name, "\r\n") != NULL) {
+        JS_FreeCString(ctx, name);
+        return JS_ThrowTypeError(ctx, "Server header must not contain CR or LF");
+    }
+    mg_http_set_server(&state->mgr, name);
+    JS_FreeCString(ctx, name);
+    return JS_UNDEFINED;
+}
+
+// Idle native states kept for reuse by HTTP and WebSocket messages, per
+// kind. 0 turns pooling off.
+static JSValue mgMgrMessagePoolSizeGet(
+    JSContext *ctx, JSValueConst this_val)
+{
+    mgMgrObj *state = getMgMgrObj(this_val);
+    if (state->httpMsgPool == NULL) return JS_NewInt64(ctx, 0);
+    return JS_NewInt64(ctx, (int64_t) mgObjPoolGetMaxIdle(state->httpMsgPool));
+}
+
+static JSValue mgMgrMessagePoolSizeSet(
+    JSContext *ctx, JSValueConst this_val, JSValueConst value)
+{
+    mgMgrObj *state = getMgMgrObj(this_val);
+    int64_t size;
+    if (JS_ToInt64(ctx, &size, value) != 0) return JS_EXCEPTION;
+    if (size < 0) return JS_ThrowRangeError(ctx, "messagePoolSize must not be negative");
+    if (state->httpMsgPool != NULL) mgObjPoolSetMaxIdle(state->httpMsgPool, (size_t) size);
+    if (state->wsMsgPool != NULL) mgObjPoolSetMaxIdle(state->wsMsgPool, (size_t) size);
+    return JS_UNDEFINED;
+}
+
+// Caches static file metadata for httpServeDir/httpServeFile, 0 entries
+// turns the cache off. ttlMs only applies where inotify is unavailable.
+static JSValue mgMgrEnableStatCache(
+    JSContext *ctx, JSValueConst this_val,
+    int argc, JSValueConst *argv)
+{
+    mgMgrObj *state = getMgMgrObj(this_val);
+    uint32_t entries;
+    int64_t ttl = 1000;
+    if (JS_ToUint32(ctx, &entries, argv[0]) != 0)
+        return JS_EXCEPTION;
+    if (argc > 1 && JS_ToInt64(ctx, &ttl, argv[1]) != 0)
+        return JS_EXCEPTION;
+    if (!mg_stat_cache_init(&state->mgr, entries, ttl < 0 ? 0 : (uint64_t) ttl))
+        return JS_ThrowOutOfMemory(ctx);
+    return JS_UNDEFINED;
+}
+
+// Keeps small static files in memory within a total byte budget, 0 turns
+// the cache off
+static JSValue mgMgrEnableAssetCache(
+    JSContext *ctx, JSValueConst this_val,
+    int argc, JSValueConst *argv)
+{
+    mgMgrObj *state = getMgMgrObj(this_val);
+    int64_t budget, maxSize = 256 * 1024;
+    if (JS_ToInt64(ctx, &budget, argv[0]) != 0)
+        return JS_EXCEPTION;
+    if (argc > 1 && JS_ToInt64(ctx, &maxSize, argv[1]) != 0)
+        return JS_EXCEPTION;
+    if (budget < 0 || maxSize < 0)
+        return JS_ThrowRangeError(ctx, "cache sizes must not be negative");
+    if (!mg_asset_cache_init(&state->mgr, (size_t) budget, (size_t) maxSize))
+        return JS_ThrowOutOfMemory(ctx);
+    return JS_UNDEFINED;
+}
+
+static JSValue mgMgrGetAssetCacheStats(JSContext *ctx, JSValueConst this_val)
+{
+    mgMgrObj *state = getMgMgrObj(this_val);
+    struct mg_asset_stats stats;
+    JSValue obj = JS_NewObject(ctx);
+    mg_asset_cache_stats(&state->mgr, &stats);
+    JS_SetPropertyStr(ctx, obj, "hits", JS_NewInt64(ctx, (int64_t) stats.hits));
+    JS_SetPropertyStr(ctx, obj, "misses", JS_NewInt64(ctx, (int64_t) stats.misses));
+    JS_SetPropertyStr(ctx, obj, "evictions", JS_NewInt64(ctx, (int64_t) stats.evictions));
+    JS_SetPropertyStr(ctx, obj, "bytes", JS_NewInt64(ctx, (int64_t) stats.bytes));
+    JS_SetPropertyStr(ctx, obj, "entries", JS_NewInt64(ctx, (int64_t) stats.count));
+    return obj;
+}
+
+// Keeps the responses of handlers that opted in, within a total byte
+// budget. 0 turns the cache off and drops every entry.
+static JSValue mgMgrEnableResponseCache(
+    JSContext *ctx, JSValueConst this_val,
+    int argc, JSValueConst *argv)
+{
+    mgMgrObj *state = getMgMgrObj(this_val);
+    int64_t budget;
+    if (JS_ToInt64(ctx, &budget, argv[0]) != 0)
+        return JS_EXCEPTION;
+    if (budget < 0)
+        return JS_ThrowRangeError(ctx, "cache size must not be negative");
+    mgRespCacheFree(state->respCache);
+    state->respCache = NULL;
+    if (budget > 0 && (state->respCache = mgRespCacheNew((size_t) budget)) == NULL)
+        return JS_ThrowOutOfMemory(ctx);
+    return JS_UNDEFINED;
+}
+
+static JSValue mgMgrGetResponseCacheStats(JSContext *ctx, JSValueConst this_val)
+{
+    mgMgrObj *state = getMgMgrObj(this_val);
+    mgRespCacheStats stats;
+    JSValue obj = JS_NewObject(ctx);
+    mgRespCacheGetStats(state->respCache, &stats);
+    JS_SetPropertyStr(ctx, obj, "hits", JS_NewInt64(ctx, (int64_t) stats.hits));
+    JS_SetPropertyStr(ctx, obj, "staleHits", JS_NewInt64(ctx, (int64_t) stats.staleHits));
+    JS_SetPropertyStr(ctx, obj, "misses", JS_NewInt64(ctx, (int64_t) stats.misses));
+    JS_SetPropertyStr(ctx, obj, "stores", JS_NewInt64(ctx, (int64_t) stats.stores));
+    JS_SetPropertyStr(ctx, obj, "evictions", JS_NewInt64(ctx, (int64_t) stats.evictions));
+    JS_SetPropertyStr(ctx, obj, "bytes", JS_NewInt64(ctx, (int64_t) stats.bytes));
+    JS_SetPropertyStr(ctx, obj, "entries", JS_NewInt64(ctx, (int64_t) stats.count));
+    return obj;
+}
+
+static JSValue mgMgrMemoryLimitGet(JSContext *ctx, JSValueConst this_val)
+{
+    mgMgrObj *state = getMgMgrObj(this_val);
+    return JS_NewInt64(ctx, state->gc.memoryLimit);
+}
+
+// Bytes the JS heap may grow to before allocations throw, 0 for no limit.
+// The limit is the runtime's, shared with everything else running in it.
+static JSValue mgMgrMemoryLimitSet(
+    JSContext *ctx, JSValueConst this_val, JSValueConst value)
+{
+    mgMgrObj *state = getMgMgrObj(this_val);
+    int64_t limit;
+    if (JS_ToInt64(ctx, &limit, value) != 0) return JS_EXCEPTION;
+    if (limit < 0) return JS_ThrowRangeError(ctx, "memoryLimit must not be negative");
+    JS_SetMemoryLimit(JS_GetRuntime(ctx), (size_t) limit);
+    state->gc.memoryLimit = limit;
+    return JS_UNDEFINED;
+}
+
+// 0 until set, QuickJS then adjusts the threshold by itself
+static JSValue mgMgrGcThresholdGet(JSContext *ctx, JSValueConst this_val)
+{
+    mgMgrObj *state = getMgMgrObj(this_val);
+    return JS_NewInt64(ctx, (int64_t) state->gc.threshold);
+}
+
+// Heap size in bytes at which QuickJS collects by itself, in the middle of
+// whatever JS runs at the time. Raised along with enableIdleGc, it keeps
+// collections out of bursts.
+static JSValue mgMgrGcThresholdSet(
+    JSContext *ctx, JSValueConst this_val, JSValueConst value)
+{
+    mgMgrObj *state = getMgMgrObj(this_val);
+    int64_t threshold;
+    if (JS_ToInt64(ctx, &threshold, value) != 0) return JS_EXCEPTION;
+    if (threshold < 0) return JS_ThrowRangeError(ctx, "gcThreshold must not be negative");
+    JS_SetGCThreshold(JS_GetRuntime(ctx), (size_t) threshold);
+    state->gc.threshold = (size_t) threshold;
+    return JS_UNDEFINED;
+}
+
+// Runs a collection now and returns its pause in milliseconds
+static JSValue mgMgrGc(
+    JSContext *ctx, JSValueConst this_val,
+    int argc, JSValueConst *argv)
+{
+    mgMgrObj *state = getMgMgrObj(this_val);
+    return JS_NewFloat64(ctx, (double) mgMgrRunGc(state, false) / 1000);
+}
+
+// Collects at the end of a poll once no event reached JS for idleMs since
+// the last one, and only when some did since the previous collection.
+// 0 turns it off.
+static JSValue mgMgrEnableIdleGc(
+    JSContext *ctx, JSValueConst this_val,
+    int argc, JSValueConst *argv)
+{
+    mgMgrObj *state = getMgMgrObj(this_val);
+    int64_t idleMs;
+    if (JS_ToInt64(ctx, &idleMs, argv[0]) != 0)
+        return JS_EXCEPTION;
+    state->gc.idleUs = idleMs < 0 ? 0 : (uint64_t) idleMs * 1000;
+    state->gc.lastBusyUs = mgMgrMicros();
+    return JS_UNDEFINED;
+}
+
+static const struct {
+    const char *name;
+    size_t offset;
+} mgMgrMemoryFields[] = {
+    { "mallocSize", offsetof(JSMemoryUsage, malloc_size) },
+    { "mallocLimit", offsetof(JSMemoryUsage, malloc_limit) },
+    { "mallocCount", offsetof(JSMemoryUsage, malloc_count) },
+    { "memoryUsedSize", offsetof(JSMemoryUsage, memory_used_size) },
+    { "memoryUsedCount", offsetof(JSMemoryUsage, memory_used_count) },
+    { "atomCount", offsetof(JSMemoryUsage, atom_count) },
+    { "atomSize", offsetof(JSMemoryUsage, atom_size) },
+    { "strCount", offsetof(JSMemoryUsage, str_count) },
+    { "strSize", offsetof(JSMemoryUsage, str_size) },
+    { "objCount", offsetof(JSMemoryUsage, obj_count) },
+    { "objSize", offsetof(JSMemoryUsage, obj_size) },
+    { "propCount", offsetof(JSMemoryUsage, prop_count) },
+    { "propSize", offsetof(JSMemoryUsage, prop_size) },
+    { "shapeCount", offsetof(JSMemoryUsage, shape_count) },
+    { "shapeSize", offsetof(JSMemoryUsage, shape_size) },
+    { "jsFuncCount", offsetof(JSMemoryUsage, js_func_count) },
+    { "jsFuncSize", offsetof(JSMemoryUsage, js_func_size) },
+    { "jsFuncCodeSize", offsetof(JSMemoryUsage, js_func_code_size) },
+    { "cFuncCount", offsetof(JSMemoryUsage, c_func_count) },
+    { "arrayCount", offsetof(JSMemoryUsage, array_count) },
+    { "fastArrayCount", offsetof(JSMemoryUsage, fast_array_count) },
+    { "fastArrayElements", offsetof(JSMemoryUsage, fast_array_elements) },
+    { "binaryObjectCount", offsetof(JSMemoryUsage, binary_object_count) },
+    { "binaryObjectSize", offsetof(JSMemoryUsage, binary_object_size) }
+};
+
+// What the runtime's heap holds, from JS_ComputeMemoryUsage. It walks every
+// object, so it is meant for monitoring rather than for each request.
+static JSValue mgMgrGetMemoryUsage(JSContext *ctx, JSValueConst this_val)
+{
+    JSMemoryUsage usage;
+    JSValue obj = JS_NewObject(ctx);
+    JS_ComputeMemoryUsage(JS_GetRuntime(ctx), &usage);
+    for (size_t i = 0; i < sizeof(mgMgrMemoryFields) / sizeof(mgMgrMemoryFields[0]); i++)
+    {
+        int64_t value = *(int64_t *) ((char *) &usage + mgMgrMemoryFields[i].offset);
+        JS_SetPropertyStr(ctx, obj, mgMgrMemoryFields[i].name, JS_NewInt64(ctx, value));
+    }
+    return obj;
+}
+
+// Pause times of the timed collections. histogram holds one
+// { upToMs, count } bucket per range, the last one up to Infinity.
+static JSValue mgMgrGetGcStats(JSContext *ctx, JSValueConst this_val)
+{
+    mgMgrObj *state = getMgMgrObj(this_val);
+    const mgMgrGcState *gc = &state->gc;
+    JSValue obj = JS_NewObject(ctx), histogram = JS_NewArray(ctx);
+    JS_SetPropertyStr(ctx, obj, "count", JS_NewInt64(ctx, (int64_t) gc->count));
+    JS_SetPropertyStr(ctx, obj, "idleCount", JS_NewInt64(ctx, (int64_t) gc->idleCount));
+    JS_SetPropertyStr(ctx, obj, "totalMs", JS_NewFloat64(ctx, (double) gc->totalUs / 1000));
+    JS_SetPropertyStr(ctx, obj, "maxMs", JS_NewFloat64(ctx, (double) gc->maxUs / 1000));
+    JS_SetPropertyStr(ctx, obj, "lastMs", JS_NewFloat64(ctx, (double) gc->lastUs / 1000));
+    for (size_t i = 0; i < MG_MGR_GC_BUCKETS; i++)
+    {
+        JSValue bucket = JS_NewObject(ctx);
+        double upTo = i < MG_MGR_GC_BUCKETS - 1 ? (double) mgMgrGcBuckets[i] / 1000 : INFINITY;
+        JS_SetPropertyStr(ctx, bucket, "upToMs", JS_NewFloat64(ctx, upTo));
+        JS_SetPropertyStr(ctx, bucket, "count", JS_NewInt64(ctx, (int64_t) gc->histogram[i]));
+        JS_SetPropertyUint32(ctx, histogram, (uint32_t) i, bucket);
+    }
+    JS_SetPropertyStr(ctx, obj, "histogram", histogram);
+    return obj;
 }
 
 static JSValue mgMgrGetConnections(
@@ -167,7 +1005,17 @@ static JSValue mgMgrGetConnections(
     int argc, JSValueConst *argv)
 {
     mgMgrObj *state = getMgMgrObj(this_val);
-    return mgConnCreate(ctx, state->mgr.conns);
+    return mgConnGetFrom(ctx, state->mgr.conns);
+}
+
+static JSValue mgMgrGetConnection(
+    JSContext *ctx, JSValueConst this_val,
+    int argc, JSValueConst *argv)
+{
+    mgMgrObj *state = getMgMgrObj(this_val);
+    int64_t id;
+    if (JS_ToInt64(ctx, &id, argv[0]) != 0) return JS_EXCEPTION;
+    return id <= 0 ? JS_NULL : mgConnFind(ctx, &state->mgr, (unsigned long) id);
 }
 
 static JSValue mgMgrCreateMqttClient(
@@ -178,6 +1026,21 @@ static JSValue mgMgrCreateMqttClient(
     return mgMqttClientCreate(ctx, &state->mgr, argc, argv);
 }
 
+// Subscribers dropped once more than maxBuffered bytes wait to be sent
+static JSValue mgMgrCreateSseGroup(
+    JSContext *ctx, JSValueConst this_val,
+    int argc, JSValueConst *argv)
+{
+    return mgSseGroupCreate(ctx, argc, argv);
+}
+
+static JSValue mgMgrCreateRouter(
+    JSContext *ctx, JSValueConst this_val,
+    int argc, JSValueConst *argv)
+{
+    return mgRouterCreate(ctx);
+}
+
 static JSCFunctionListEntry mgMgrClassFuncs[] = {
     JS_CFUNC_DEF("httpListen", 1, mgMgrHttpListen),
     JS_CFUNC_DEF("poll", 1, mgMgrPoll),
@@ -186,9 +1049,28 @@ static JSCFunctionListEntry mgMgrClassFuncs[] = {
     JS_CGETSET_MAGIC_DEF("onHttpClose", mgMgrEventGet, mgMgrEventSet, MG_MGR_EVENT_HTTP_CLOSE),
     JS_CGETSET_MAGIC_DEF("onWsOpen", mgMgrEventGet, mgMgrEventSet, MG_MGR_EVENT_WS_OPEN),
     JS_CGETSET_MAGIC_DEF("onWsMessage", mgMgrEventGet, mgMgrEventSet, MG_MGR_EVENT_WS_MESSAGE),
+    JS_CGETSET_MAGIC_DEF("onHttpBatch", mgMgrEventGet, mgMgrEventSet, MG_MGR_EVENT_HTTP_BATCH),
+    JS_CGETSET_MAGIC_DEF("onHttpDrain", mgMgrEventGet, mgMgrEventSet, MG_MGR_EVENT_HTTP_DRAIN),
     JS_CGETSET_MAGIC_DEF("onSntpMessage", mgMgrEventGet, mgMgrEventSet, MG_MGR_EVENT_SNTP_MESSAGE),
+    JS_CGETSET_MAGIC_DEF("onEventBatch", mgMgrEventGet, mgMgrEventSet, MG_MGR_EVENT_BATCH),
+    JS_CGETSET_DEF("serverHeader", mgMgrServerHeaderGet, mgMgrServerHeaderSet),
+    JS_CGETSET_DEF("messagePoolSize", mgMgrMessagePoolSizeGet, mgMgrMessagePoolSizeSet),
+    JS_CFUNC_DEF("enableStatCache", 2, mgMgrEnableStatCache),
+    JS_CFUNC_DEF("enableAssetCache", 2, mgMgrEnableAssetCache),
+    JS_CGETSET_DEF("assetCacheStats", mgMgrGetAssetCacheStats, NULL),
+    JS_CFUNC_DEF("enableResponseCache", 1, mgMgrEnableResponseCache),
+    JS_CGETSET_DEF("responseCacheStats", mgMgrGetResponseCacheStats, NULL),
+    JS_CGETSET_DEF("memoryLimit", mgMgrMemoryLimitGet, mgMgrMemoryLimitSet),
+    JS_CGETSET_DEF("gcThreshold", mgMgrGcThresholdGet, mgMgrGcThresholdSet),
+    JS_CFUNC_DEF("gc", 0, mgMgrGc),
+    JS_CFUNC_DEF("enableIdleGc", 1, mgMgrEnableIdleGc),
+    JS_CGETSET_DEF("memoryUsage", mgMgrGetMemoryUsage, NULL),
+    JS_CGETSET_DEF("gcStats", mgMgrGetGcStats, NULL),
     JS_CFUNC_DEF("getConnections", 0, mgMgrGetConnections),
-    JS_CFUNC_DEF("createMqttClient", 0, mgMgrCreateMqttClient)
+    JS_CFUNC_DEF("getConnection", 1, mgMgrGetConnection),
+    JS_CFUNC_DEF("createMqttClient", 0, mgMgrCreateMqttClient),
+    JS_CFUNC_DEF("createSseGroup", 1, mgMgrCreateSseGroup),
+    JS_CFUNC_DEF("createRouter", 0, mgMgrCreateRouter)
 };
 
 JSFullClassDef mgMgrClass = {
@@ -2,7 +2,23 @@
 #define __MONGOOSE_MANAGER_JS_H
 
 #include "js-utils.h"
+#include "http-compress.h"
+#include "response-cache.h"
+#include "conn-map.h"
 
 extern JSFullClassDef mgMgrClass;
 
+// Connections of the manager that owns mgr, by id
+mgConnMap *mgMgrGetConnMap(struct mg_mgr *mgr);
+// Calls fn with arg like the manager's own events, that is with the other
+// events of the poll when onEventBatch is set. Takes arg over.
+void mgMgrEmit(struct mg_mgr *mgr, JSValueConst fn, JSValue arg);
+// Compression settings of the listener that accepted an HTTP connection
+const mgCompressOpts *mgMgrGetCompressOpts(struct mg_connection *c);
+// Response cache of the manager owning an HTTP connection, NULL if disabled
+mgRespCache *mgMgrGetRespCache(struct mg_connection *c);
+// Calls onHttpDrain with the connection id once at most watermark bytes
+// are left to send. Returns false when out of memory.
+bool mgMgrWatchDrain(struct mg_connection *c, size_t watermark);
+
 #endif
\ No newline at end of file
@@ -1,5 +1,7 @@
 #include "MongooseMqttClient-js.h"
 #include "MongooseMqttMessage-js.h"
+#include "MongooseConnection-js.h"
+#include "MongooseManager-js.h"
 #include "mongoose.h"
 
 enum {
@@ -38,7 +40,9 @@ static void mgMqttClientGcMark(JSRuntime *rt, JSValueConst val, JS_MarkFunc *mar
 
 static void mgMqttClientCb(struct mg_connection *c, int ev, void *ev_data, void *fn_data) {
     mgMqttClientObj *state = fn_data;
-    if (ev == MG_EV_ERROR) {
+    if (ev == MG_EV_OPEN) {
+        mgConnOpened(c);
+    } else if (ev == MG_EV_ERROR) {
         // On error, log error message
         MG_ERROR(("%p %s", c->fd, (char *) ev_data));
     } else if (ev == MG_EV_CONNECT) {
@@ -49,27 +53,16 @@ static void mgMqttClientCb(struct mg_connection *c, int ev, void *ev_data, void
             mg_tls_init(c, &opts);
         }
     } else if (ev == MG_EV_MQTT_OPEN) {
-        JSValue fn = state->events[MG_MQTT_CLIENT_EVENT_ON_OPEN];
-        if (JS_IsFunction(state->ctx, fn))
-            JS_Call(state->ctx, fn, JS_UNDEFINED, 0, NULL);
+        mgMgrEmit(c->mgr, state->events[MG_MQTT_CLIENT_EVENT_ON_OPEN], JS_UNDEFINED);
     } else if (ev == MG_EV_MQTT_CMD) {
         struct mg_mqtt_message *mm = (struct mg_mqtt_message *) ev_data;
-        JSValue jsMsg = mgMqttMsgCreate(state->ctx, c, mm);
-        JSValue fn = state->events[MG_MQTT_CLIENT_EVENT_ON_CMD];
-        if (JS_IsFunction(state->ctx, fn))
-            JS_Call(state->ctx, fn, JS_UNDEFINED, 1, &jsMsg);
-        JS_FreeValue(state->ctx, jsMsg);
+        mgMgrEmit(c->mgr, state->events[MG_MQTT_CLIENT_EVENT_ON_CMD], mgMqttMsgCreate(state->ctx, c, mm));
     } else if (ev == MG_EV_MQTT_MSG) {
         struct mg_mqtt_message *mm = (struct mg_mqtt_message *) ev_data;
-        JSValue jsMsg = mgMqttMsgCreate(state->ctx, c, mm);
-        JSValue fn = state->events[MG_MQTT_CLIENT_EVENT_ON_MESSAGE];
-        if (JS_IsFunction(state->ctx, fn))
-            JS_Call(state->ctx, fn, JS_UNDEFINED, 1, &jsMsg);
-        JS_FreeValue(state->ctx, jsMsg);
+        mgMgrEmit(c->mgr, state->events[MG_MQTT_CLIENT_EVENT_ON_MESSAGE], mgMqttMsgCreate(state->ctx, c, mm));
     } else if (ev == MG_EV_CLOSE) {
-        JSValue fn = state->events[MG_MQTT_CLIENT_EVENT_ON_CLOSE];
-        if (JS_IsFunction(state->ctx, fn))
-            JS_Call(state->ctx, fn, JS_UNDEFINED, 0, NULL);
+        mgMgrEmit(c->mgr, state->events[MG_MQTT_CLIENT_EVENT_ON_CLOSE], JS_UNDEFINED);
+        mgConnClosed(state->ctx, c);
     }
 }
 
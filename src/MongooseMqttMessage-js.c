@@ -4,8 +4,10 @@
 typedef struct {
     JSContext *ctx;
     struct mg_connection *conn;
-    struct mg_mqtt_message *msg;
+    struct mg_mqtt_message *msg;    // NULL once the event is over
     JSValue jsConnection;
+    struct mg_mqtt_message copy;    // See mgMqttMsgPin()
+    char *pinned;                   // Topic and data of copy
 } mgMqttMsgObj;
 
 static mgMqttMsgObj* getMgMqttMsgObj(JSValueConst this_val) 
@@ -17,6 +19,7 @@ static void mgMqttMsgFinalizer(JSRuntime *rt, JSValue val)
 {
     mgMqttMsgObj *state = getMgMqttMsgObj(val);
     JS_FreeValueRT(rt, state->jsConnection);
+    js_free_rt(rt, state->pinned);
     js_free(state->ctx, state);
 }
 
@@ -40,36 +43,89 @@ JSValue mgMqttMsgCreate(JSContext *ctx, struct mg_connection *conn, struct mg_mq
     return obj;
 }
 
+void mgMqttMsgPin(JSValueConst obj)
+{
+    mgMqttMsgObj *state = getMgMqttMsgObj(obj);
+    struct mg_mqtt_message *msg;
+    if (state == NULL || (msg = state->msg) == NULL || msg == &state->copy) return;
+    if (JS_IsUndefined(state->jsConnection))
+        state->jsConnection = mgConnGet(state->ctx, state->conn);
+    state->copy = *msg;
+    state->copy.dgram = mg_str_n(NULL, 0);
+    state->pinned = js_malloc(state->ctx, msg->topic.len + msg->data.len + 1);
+    if (state->pinned != NULL)
+    {
+        memcpy(state->pinned, msg->topic.ptr, msg->topic.len);
+        memcpy(state->pinned + msg->topic.len, msg->data.ptr, msg->data.len);
+        state->copy.topic.ptr = state->pinned;
+        state->copy.data.ptr = state->pinned + msg->topic.len;
+    }
+    else
+    {
+        state->copy.topic = state->copy.data = mg_str_n(NULL, 0);
+    }
+    state->msg = &state->copy;
+    state->conn = NULL;
+}
+
+void mgMqttMsgRelease(JSValueConst obj)
+{
+    mgMqttMsgObj *state = getMgMqttMsgObj(obj);
+    if (state == NULL || state->msg == NULL) return;
+    state->msg = NULL;
+    state->conn = NULL;
+    js_free(state->ctx, state->pinned);
+    state->pinned = NULL;
+}
+
+static struct mg_mqtt_message *getMessage(JSContext *ctx, mgMqttMsgObj *state)
+{
+    if (state->msg == NULL)
+        JS_ThrowTypeError(ctx, "the message is only available during its event");
+    return state->msg;
+}
+
 static JSValue mgMqttMsgGetMessage(JSContext *ctx, JSValueConst this_val)
 {
     mgMqttMsgObj *state = getMgMqttMsgObj(this_val);
-    return JS_NewStringLen(ctx, state->msg->data.ptr, state->msg->data.len);
+    struct mg_mqtt_message *msg = getMessage(ctx, state);
+    if (msg == NULL) return JS_EXCEPTION;
+    return JS_NewStringLen(ctx, msg->data.ptr, msg->data.len);
 }
 
 static JSValue mgMqttMsgGetTopic(JSContext *ctx, JSValueConst this_val)
 {
     mgMqttMsgObj *state = getMgMqttMsgObj(this_val);
-    return JS_NewStringLen(ctx, state->msg->topic.ptr, state->msg->topic.len);
+    struct mg_mqtt_message *msg = getMessage(ctx, state);
+    if (msg == NULL) return JS_EXCEPTION;
+    return JS_NewStringLen(ctx, msg->topic.ptr, msg->topic.len);
 }
 
 static JSValue mgMqttMsgGetConnection(JSContext *ctx, JSValueConst this_val)
 {
     mgMqttMsgObj *state = getMgMqttMsgObj(this_val);
     if (JS_IsUndefined(state->jsConnection)) 
-        state->jsConnection = mgConnCreate(ctx, state->conn);
+    {
+        if (getMessage(ctx, state) == NULL) return JS_EXCEPTION;
+        state->jsConnection = mgConnGet(ctx, state->conn);
+    }
     return JS_DupValue(ctx, state->jsConnection);
 }
 
 static JSValue mgMqttMsgGetQos(JSContext *ctx, JSValueConst this_val)
 {
     mgMqttMsgObj *state = getMgMqttMsgObj(this_val);
-    return JS_NewInt32(ctx, state->msg->qos);
+    struct mg_mqtt_message *msg = getMessage(ctx, state);
+    if (msg == NULL) return JS_EXCEPTION;
+    return JS_NewInt32(ctx, msg->qos);
 }
 
 static JSValue mgMqttMsgGetCommand(JSContext *ctx, JSValueConst this_val)
 {
     mgMqttMsgObj *state = getMgMqttMsgObj(this_val);
-    return JS_NewInt32(ctx, state->msg->cmd);
+    struct mg_mqtt_message *msg = getMessage(ctx, state);
+    if (msg == NULL) return JS_EXCEPTION;
+    return JS_NewInt32(ctx, msg->cmd);
 }
 
 static JSCFunctionListEntry mgMqttMsgClassFuncs[] = {
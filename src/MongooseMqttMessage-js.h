@@ -6,5 +6,11 @@
 
 extern JSFullClassDef mgMqttMsgClass;
 JSValue mgMqttMsgCreate(JSContext *ctx, struct mg_connection *conn, struct mg_mqtt_message *msg);
+// Copies the topic and data of a message whose callback runs after its
+// event, see onEventBatch. Does nothing for other values.
+void mgMqttMsgPin(JSValueConst obj);
+// Called when the event that created a message ends, it can no longer be
+// read then
+void mgMqttMsgRelease(JSValueConst obj);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,265 @@
+#include "MongooseResponseHeaders-js.h"
+
+// Response headers are kept in wire format: one growable buffer holding
+// "Name: value\r\n" lines plus a small index of where each line starts.
+// Writing a reply is then a single copy of the buffer into c->send.
+typedef struct {
+    uint32_t offset;
+    uint32_t len;
+    uint32_t nameLen;
+} mgRespHeader;
+
+typedef struct {
+    JSContext *ctx;
+    mgRespHeader *headers;
+    int count;
+    int capacity;
+    char *buf;
+    size_t len;
+    size_t size;
+} mgRespHeadersObj;
+
+// Canonical spelling of common headers, copied instead of the name given
+// by the caller. Content-Length is always derived from the reply body.
+static const struct mg_str knownHeaders[] = {
+    MG_C_STR("Content-Type"),
+    MG_C_STR("Cache-Control"),
+    MG_C_STR("Connection"),
+    MG_C_STR("Content-Encoding"),
+    MG_C_STR("Date"),
+    MG_C_STR("ETag"),
+    MG_C_STR("Last-Modified"),
+    MG_C_STR("Location"),
+    MG_C_STR("Server"),
+    MG_C_STR("Set-Cookie"),
+    MG_C_STR("Vary"),
+};
+
+static const struct mg_str contentLengthHeader = MG_C_STR("Content-Length");
+
+static mgRespHeadersObj* getMgRespHeadersObj(JSValueConst this_val) 
+{
+    return JS_GetOpaque(this_val, mgRespHeadersClass.id);
+}
+
+static void mgRespHeadersFinalizer(JSRuntime *rt, JSValue val) 
+{
+    mgRespHeadersObj *state = getMgRespHeadersObj(val);
+    js_free(state->ctx, state->headers);
+    js_free(state->ctx, state->buf);
+    js_free(state->ctx, state);
+}
+
+JSValue mgRespHeadersCreate(JSContext *ctx)
+{
+    JSValue obj = JS_NewObjectClass(ctx, mgRespHeadersClass.id);
+    mgRespHeadersObj *state;
+    state = js_mallocz(ctx, sizeof(*state));
+    state->ctx = ctx;
+    JS_SetOpaque(obj, state);
+    return obj;
+}
+
+const char *mgRespHeadersGetBlock(JSValueConst obj, size_t *len)
+{
+    mgRespHeadersObj *state = getMgRespHeadersObj(obj);
+    if (state == NULL) return NULL;
+    if (len != NULL) *len = state->len;
+    return state->buf == NULL ? "" : state->buf;
+}
+
+static bool sameName(struct mg_str a, const char *b, size_t bLen)
+{
+    return a.len == bLen && mg_ncasecmp(a.ptr, b, bLen) == 0;
+}
+
+static int findHeader(mgRespHeadersObj *state, const char *name, size_t nameLen)
+{
+    for (int i = 0; i < state->count; i++) {
+        mgRespHeader *h = &state->headers[i];
+        if (sameName(mg_str_n(state->buf + h->offset, h->nameLen), name, nameLen))
+            return i;
+    }
+    return -1;
+}
+
+static void removeHeader(mgRespHeadersObj *state, int idx)
+{
+    mgRespHeader h = state->headers[idx];
+    memmove(state->buf + h.offset, state->buf + h.offset + h.len, state->len - h.offset - h.len + 1);
+    state->len -= h.len;
+    for (int i = idx + 1; i < state->count; i++) {
+        state->headers[i - 1] = state->headers[i];
+        state->headers[i - 1].offset -= h.len;
+    }
+    state->count--;
+}
+
+static bool isValidHeader(const char *name, size_t nameLen, const char *value, size_t valueLen)
+{
+    if (nameLen == 0) return false;
+    for (size_t i = 0; i < nameLen; i++)
+        if (name[i] <= ' ' || name[i] == ':' || name[i] == 0x7f) return false;
+    for (size_t i = 0; i < valueLen; i++)
+        if (value[i] == '\r' || value[i] == '\n' || value[i] == '\0') return false;
+    return true;
+}
+
+static int appendHeader(
+    mgRespHeadersObj *state, const char *name, size_t nameLen, 
+    const char *value, size_t valueLen)
+{
+    JSContext *ctx = state->ctx;
+    size_t lineLen = nameLen + 2 + valueLen + 2;
+    mgRespHeader *h;
+    char *p;
+    for (size_t i = 0; i < countof(knownHeaders); i++) {
+        if (sameName(knownHeaders[i], name, nameLen)) {
+            name = knownHeaders[i].ptr;
+            break;
+        }
+    }
+    if (state->count == state->capacity) {
+        int capacity = state->capacity == 0 ? 8 : state->capacity * 2;
+        mgRespHeader *headers = js_realloc(ctx, state->headers, sizeof(*headers) * capacity);
+        if (headers == NULL) return -1;
+        state->headers = headers;
+        state->capacity = capacity;
+    }
+    if (state->len + lineLen + 1 > state->size) {
+        size_t size = MIN(state->size * 2, state->size + 4096);
+        char *buf;
+        if (size < state->len + lineLen + 1) size = state->len + lineLen + 1 + 128;
+        buf = js_realloc(ctx, state->buf, size);
+        if (buf == NULL) return -1;
+        state->buf = buf;
+        state->size = size;
+    }
+    p = state->buf + state->len;
+    memcpy(p, name, nameLen);
+    memcpy(p + nameLen, ": ", 2);
+    memcpy(p + nameLen + 2, value, valueLen);
+    memcpy(p + lineLen - 2, "\r\n", 3);
+    h = &state->headers[state->count++];
+    h->offset = state->len;
+    h->len = lineLen;
+    h->nameLen = nameLen;
+    state->len += lineLen;
+    return 0;
+}
+
+enum {
+    MG_RESP_HEADERS_APPEND,
+    MG_RESP_HEADERS_SET,
+};
+
+static JSValue mgRespHeadersSet(
+    JSContext *ctx, JSValueConst this_val,
+    int argc, JSValueConst *argv, int magic)
+{
+    mgRespHeadersObj *state = getMgRespHeadersObj(this_val);
+    size_t nameLen, valueLen;
+    const char *name, *value;
+    JSValue res = JS_DupValue(ctx, this_val);
+    if (argc < 2) return JS_ThrowTypeError(ctx, "header name and value required");
+    name = JS_ToCStringLen(ctx, &nameLen, argv[0]);
+    value = JS_ToCStringLen(ctx, &valueLen, argv[1]);
+    if (name == NULL || value == NULL) 
+    {
+        JS_FreeValue(ctx, res);
+        res = JS_EXCEPTION;
+    }
+    else if (!isValidHeader(name, nameLen, value, valueLen)) 
+    {
+        JS_FreeValue(ctx, res);
+        res = JS_ThrowTypeError(ctx, "invalid header");
+    }
+    else if (!sameName(contentLengthHeader, name, nameLen)) 
+    {
+        int idx;
+        if (magic == MG_RESP_HEADERS_SET)
+            while ((idx = findHeader(state, name, nameLen)) >= 0) removeHeader(state, idx);
+        if (appendHeader(state, name, nameLen, value, valueLen) != 0) 
+        {
+            JS_FreeValue(ctx, res);
+            res = JS_ThrowOutOfMemory(ctx);
+        }
+    }
+    JS_FreeCString(ctx, name);
+    JS_FreeCString(ctx, value);
+    return res;
+}
+
+static JSValue mgRespHeadersGet(
+    JSContext *ctx, JSValueConst this_val,
+    int argc, JSValueConst *argv)
+{
+    mgRespHeadersObj *state = getMgRespHeadersObj(this_val);
+    size_t nameLen;
+    const char *name = JS_ToCStringLen(ctx, &nameLen, argv[0]);
+    JSValue res = JS_UNDEFINED;
+    int idx;
+    if (name == NULL) return JS_EXCEPTION;
+    if ((idx = findHeader(state, name, nameLen)) >= 0) 
+    {
+        mgRespHeader *h = &state->headers[idx];
+        res = JS_NewStringLen(ctx, state->buf + h->offset + h->nameLen + 2, h->len - h->nameLen - 4);
+    }
+    JS_FreeCString(ctx, name);
+    return res;
+}
+
+static JSValue mgRespHeadersHas(
+    JSContext *ctx, JSValueConst this_val,
+    int argc, JSValueConst *argv)
+{
+    mgRespHeadersObj *state = getMgRespHeadersObj(this_val);
+    size_t nameLen;
+    const char *name = JS_ToCStringLen(ctx, &nameLen, argv[0]);
+    bool found;
+    if (name == NULL) return JS_EXCEPTION;
+    found = findHeader(state, name, nameLen) >= 0;
+    JS_FreeCString(ctx, name);
+    return JS_NewBool(ctx, found);
+}
+
+static JSValue mgRespHeadersDelete(
+    JSContext *ctx, JSValueConst this_val,
+    int argc, JSValueConst *argv)
+{
+    mgRespHeadersObj *state = getMgRespHeadersObj(this_val);
+    size_t nameLen;
+    const char *name = JS_ToCStringLen(ctx, &nameLen, argv[0]);
+    int idx;
+    if (name == NULL) return JS_EXCEPTION;
+    while ((idx = findHeader(state, name, nameLen)) >= 0) removeHeader(state, idx);
+    JS_FreeCString(ctx, name);
+    return JS_UNDEFINED;
+}
+
+static JSValue mgRespHeadersToString(
+    JSContext *ctx, JSValueConst this_val,
+    int argc, JSValueConst *argv)
+{
+    mgRespHeadersObj *state = getMgRespHeadersObj(this_val);
+    return JS_NewStringLen(ctx, state->buf == NULL ? "" : state->buf, state->len);
+}
+
+static JSCFunctionListEntry mgRespHeadersClassFuncs[] = {
+    JS_CFUNC_MAGIC_DEF("set", 2, mgRespHeadersSet, MG_RESP_HEADERS_SET),
+    JS_CFUNC_MAGIC_DEF("append", 2, mgRespHeadersSet, MG_RESP_HEADERS_APPEND),
+    JS_CFUNC_DEF("get", 1, mgRespHeadersGet),
+    JS_CFUNC_DEF("has", 1, mgRespHeadersHas),
+    JS_CFUNC_DEF("delete", 1, mgRespHeadersDelete),
+    JS_CFUNC_DEF("toString", 0, mgRespHeadersToString)
+};
+
+JSFullClassDef mgRespHeadersClass = {
+    .def = {
+        .class_name = "MongooseResponseHeaders",
+        .finalizer = mgRespHeadersFinalizer,
+    },
+    .constructor = { NULL, 0 },
+    .funcs_len = sizeof(mgRespHeadersClassFuncs),
+    .funcs = mgRespHeadersClassFuncs
+};
@@ -0,0 +1,13 @@
+#ifndef __MONGOOSE_RESPONSE_HEADERS_JS_H
+#define __MONGOOSE_RESPONSE_HEADERS_JS_H
+
+#include "mongoose.h"
+#include "js-utils.h"
+
+extern JSFullClassDef mgRespHeadersClass;
+JSValue mgRespHeadersCreate(JSContext *ctx);
+// Serialized "Name: value\r\n" lines of a MongooseResponseHeaders object,
+// NUL-terminated. Returns NULL if obj is not such an object.
+const char *mgRespHeadersGetBlock(JSValueConst obj, size_t *len);
+
+#endif
@@ -0,0 +1,315 @@
+#include "MongooseRouter-js.h"
+#include "MongooseHttpMessage-js.h"
+#include "route-tree.h"
+
+typedef struct {
+    JSAtom name;
+    bool repeated;              // The value is an array of segments
+} mgRouteParam;
+
+typedef struct {
+    JSValue handler;
+    uint32_t index;
+    size_t numParams;
+    mgRouteParam params[MG_ROUTE_MAX_PARAMS];
+} mgRoute;
+
+typedef struct {
+    JSContext *ctx;
+    mgRouteTree *tree;
+    mgRoute **routes;
+    size_t len;
+    size_t cap;
+} mgRouterObj;
+
+static mgRouterObj* getMgRouterObj(JSValueConst this_val)
+{
+    return JS_GetOpaque(this_val, mgRouterClass.id);
+}
+
+static void freeRoute(JSRuntime *rt, mgRoute *r)
+{
+    for (size_t i = 0; i < r->numParams; i++) JS_FreeAtomRT(rt, r->params[i].name);
+    JS_FreeValueRT(rt, r->handler);
+    free(r);
+}
+
+static void mgRouterFinalizer(JSRuntime *rt, JSValue val)
+{
+    mgRouterObj *state = getMgRouterObj(val);
+    for (size_t i = 0; i < state->len; i++) freeRoute(rt, state->routes[i]);
+    free(state->routes);
+    mgRouteTreeFree(state->tree);
+    js_free_rt(rt, state);
+}
+
+static void mgRouterGcMark(JSRuntime *rt, JSValueConst val, JS_MarkFunc *mark_func)
+{
+    mgRouterObj *state = getMgRouterObj(val);
+    if (state)
+        for (size_t i = 0; i < state->len; i++)
+            JS_MarkValue(rt, state->routes[i]->handler, mark_func);
+}
+
+JSValue mgRouterCreate(JSContext *ctx)
+{
+    JSValue obj = JS_NewObjectClass(ctx, mgRouterClass.id);
+    mgRouterObj *state;
+    if (JS_IsException(obj)) return obj;
+    state = js_mallocz(ctx, sizeof(*state));
+    if (state == NULL || (state->tree = mgRouteTreeNew()) == NULL)
+    {
+        js_free(ctx, state);
+        JS_FreeValue(ctx, obj);
+        return JS_ThrowOutOfMemory(ctx);
+    }
+    state->ctx = ctx;
+    JS_SetOpaque(obj, state);
+    return obj;
+}
+
+static const struct {
+    const char *name;
+    mgRouteSegKind kind;
+} mgRouteSegKinds[] = {
+    { "param", MG_ROUTE_SEG_PARAM },
+    { "optional", MG_ROUTE_SEG_OPTIONAL },
+    { "oneOrMore", MG_ROUTE_SEG_ONE_OR_MORE },
+    { "zeroOrMore", MG_ROUTE_SEG_ZERO_OR_MORE },
+    { "catchAll", MG_ROUTE_SEG_CATCH_ALL }
+};
+
+// Reads a segment: a string for static text, or { name, kind } for a
+// parameter. Returns 1 when the kind is unknown.
+static int toRouteSeg(JSContext *ctx, JSValueConst val, mgRouteSeg *seg, mgRoute *r)
+{
+    JSValue kind;
+    const char *str;
+    int res = 1;
+    if (JS_IsString(val))
+    {
+        seg->kind = MG_ROUTE_SEG_STATIC;
+        seg->text = JS_ToCStringLen(ctx, &seg->len, val);
+        return seg->text == NULL ? -1 : 0;
+    }
+    if (r->numParams == MG_ROUTE_MAX_PARAMS) return 1;
+    kind = JS_GetPropertyStr(ctx, val, "kind");
+    str = JS_ToCString(ctx, kind);
+    JS_FreeValue(ctx, kind);
+    if (str == NULL) return -1;
+    for (size_t i = 0; i < countof(mgRouteSegKinds); i++)
+    {
+        if (strcmp(str, mgRouteSegKinds[i].name) != 0) continue;
+        JSValue name = JS_GetPropertyStr(ctx, val, "name");
+        mgRouteParam *p = &r->params[r->numParams];
+        seg->kind = mgRouteSegKinds[i].kind;
+        seg->text = NULL;
+        p->name = JS_ValueToAtom(ctx, name);
+        p->repeated = seg->kind == MG_ROUTE_SEG_ONE_OR_MORE || seg->kind == MG_ROUTE_SEG_ZERO_OR_MORE;
+        JS_FreeValue(ctx, name);
+        res = p->name == JS_ATOM_NULL ? -1 : 0;
+        if (res == 0) r->numParams++;
+        break;
+    }
+    JS_FreeCString(ctx, str);
+    return res;
+}
+
+// add(index, method, segments, handler): the route "/segments[0]/..." for
+// handler, which find() returns. Routes registered with a lower index win.
+// Returns false when the segments cannot go into the tree, the route has
+// to be matched some other way then.
+static JSValue mgRouterAdd(
+    JSContext *ctx, JSValueConst this_val,
+    int argc, JSValueConst *argv)
+{
+    mgRouterObj *state = getMgRouterObj(this_val);
+    uint32_t index, n = JS_GetArrayLength(ctx, argv[2]), i;
+    const char *method = NULL;
+    mgRouteSeg *segs = NULL;
+    mgRoute *r = NULL;
+    int res = -1;
+    if (JS_ToUint32(ctx, &index, argv[0]) != 0 ||
+            (method = JS_ToCString(ctx, argv[1])) == NULL)
+        goto done;
+    segs = js_mallocz(ctx, (n + 1) * sizeof(*segs));
+    r = calloc(1, sizeof(*r));
+    if (segs == NULL || r == NULL)
+    {
+        JS_ThrowOutOfMemory(ctx);
+        goto done;
+    }
+    r->index = index;
+    r->handler = JS_UNDEFINED;
+    for (i = 0, res = 0; i < n && res == 0; i++)
+    {
+        JSValue val = JS_GetPropertyUint32(ctx, argv[2], i);
+        res = toRouteSeg(ctx, val, &segs[i], r);
+        JS_FreeValue(ctx, val);
+    }
+    if (res == 0 && state->len == state->cap)
+    {
+        size_t cap = state->cap == 0 ? 16 : state->cap * 2;
+        mgRoute **routes = realloc(state->routes, cap * sizeof(*routes));
+        if (routes == NULL)
+        {
+            JS_ThrowOutOfMemory(ctx);
+            res = -1;
+        }
+        else
+        {
+            state->routes = routes;
+            state->cap = cap;
+        }
+    }
+    if (res == 0 && mgRouteTreeAdd(state->tree, method, segs, n, index, r) != 0)
+        res = 1;
+    if (res == 0)
+    {
+        r->handler = JS_DupValue(ctx, argv[3]);
+        state->routes[state->len++] = r;
+        r = NULL;
+    }
+done:
+    if (segs != NULL)
+        for (i = 0; i < n; i++) JS_FreeCString(ctx, segs[i].text);
+    js_free(ctx, segs);
+    if (r != NULL) freeRoute(JS_GetRuntime(ctx), r);
+    JS_FreeCString(ctx, method);
+    return res < 0 ? JS_EXCEPTION : JS_NewBool(ctx, res == 0);
+}
+
+// Whether s is UTF-8 that decodeURIComponent() accepts: no overlong
+// forms, surrogates or code points past U+10FFFF
+static bool isUtf8(const unsigned char *s, size_t len)
+{
+    size_t i = 0;
+    while (i < len)
+    {
+        unsigned char c = s[i];
+        size_t n = c < 0x80 ? 0 : c >= 0xc2 && c <= 0xdf ? 1 :
+            c >= 0xe0 && c <= 0xef ? 2 : c >= 0xf0 && c <= 0xf4 ? 3 : SIZE_MAX;
+        if (n == SIZE_MAX || len - i <= n) return false;
+        for (size_t k = 1; k <= n; k++)
+            if ((s[i + k] & 0xc0) != 0x80) return false;
+        if ((c == 0xe0 && s[i + 1] < 0xa0) || (c == 0xed && s[i + 1] > 0x9f) ||
+                (c == 0xf0 && s[i + 1] < 0x90) || (c == 0xf4 && s[i + 1] > 0x8f))
+            return false;
+        i += n + 1;
+    }
+    return true;
+}
+
+// Percent-decoded like decodeURIComponent(). A value that it would reject,
+// either malformed escapes or invalid UTF-8, is kept verbatim, as by the
+// decodeParam() of js/mongoose.js for the routes matched by regexp.
+static JSValue decodeParam(JSContext *ctx, const char *ptr, size_t len)
+{
+    JSValue res;
+    char *buf;
+    int n;
+    if (memchr(ptr, '%', len) == NULL) return JS_NewStringLen(ctx, ptr, len);
+    if ((buf = js_malloc(ctx, len + 1)) == NULL) return JS_EXCEPTION;
+    n = mg_url_decode(ptr, len, buf, len + 1, 0);
+    if (n < 0 || !isUtf8((const unsigned char *) buf, n))
+        res = JS_NewStringLen(ctx, ptr, len);
+    else
+        res = JS_NewStringLen(ctx, buf, n);
+    js_free(ctx, buf);
+    return res;
+}
+
+static JSValue decodeSegments(JSContext *ctx, struct mg_str *val)
+{
+    JSValue arr = JS_NewArray(ctx);
+    const char *p = val->ptr, *end = val->ptr + val->len;
+    uint32_t i = 0;
+    while (!JS_IsException(arr))
+    {
+        const char *slash = memchr(p, '/', end - p);
+        size_t len = (slash == NULL ? end : slash) - p;
+        JSValue seg = decodeParam(ctx, p, len);
+        if (JS_IsException(seg) || JS_SetPropertyUint32(ctx, arr, i++, seg) < 0)
+        {
+            JS_FreeValue(ctx, arr);
+            return JS_EXCEPTION;
+        }
+        if (slash == NULL) break;
+        p = slash + 1;
+    }
+    return arr;
+}
+
+static JSValue routeParams(JSContext *ctx, const mgRoute *r, mgRouteMatch *m)
+{
+    JSValue params = JS_NewObjectProto(ctx, JS_NULL);
+    for (size_t i = 0; i < m->numParams && !JS_IsException(params); i++)
+    {
+        JSValue val;
+        if (m->params[i].ptr == NULL) continue; // Skipped optional parameter
+        if (r->params[i].repeated)
+            val = decodeSegments(ctx, &m->params[i]);
+        else
+            val = decodeParam(ctx, m->params[i].ptr, m->params[i].len);
+        if (JS_IsException(val) ||
+                JS_DefinePropertyValue(ctx, params, r->params[i].name, val, JS_PROP_C_W_E) < 0)
+        {
+            JS_FreeValue(ctx, params);
+            return JS_EXCEPTION;
+        }
+    }
+    return params;
+}
+
+// find(msg, from): { index, handler, params } for the first route matching
+// the method and URI of an HttpMessage, among those with an index not
+// below from. null when none does.
+static JSValue mgRouterFind(
+    JSContext *ctx, JSValueConst this_val,
+    int argc, JSValueConst *argv)
+{
+    mgRouterObj *state = getMgRouterObj(this_val);
+    struct mg_http_message *hm = mgHttpMsgGetMessage(argv[0]);
+    mgRouteMatch m;
+    uint32_t from = 0;
+    JSValue res, params;
+    const mgRoute *r;
+    if (hm == NULL) return JS_ThrowTypeError(ctx, "not a request that can still be answered");
+    if (argc > 1 && JS_ToUint32(ctx, &from, argv[1]) != 0) return JS_EXCEPTION;
+    if (!mgRouteTreeFind(state->tree, hm->method, hm->uri, from, &m)) return JS_NULL;
+    r = m.data;
+    if (JS_IsException(params = routeParams(ctx, r, &m))) return params;
+    res = JS_NewObject(ctx);
+    if (JS_IsException(res))
+    {
+        JS_FreeValue(ctx, params);
+        return res;
+    }
+    JS_SetPropertyStr(ctx, res, "index", JS_NewUint32(ctx, r->index));
+    JS_SetPropertyStr(ctx, res, "handler", JS_DupValue(ctx, r->handler));
+    JS_SetPropertyStr(ctx, res, "params", params);
+    return res;
+}
+
+static JSValue mgRouterGetSize(JSContext *ctx, JSValueConst this_val)
+{
+    mgRouterObj *state = getMgRouterObj(this_val);
+    return JS_NewInt64(ctx, (int64_t) state->len);
+}
+
+static JSCFunctionListEntry mgRouterClassFuncs[] = {
+    JS_CFUNC_DEF("add", 4, mgRouterAdd),
+    JS_CFUNC_DEF("find", 2, mgRouterFind),
+    JS_CGETSET_DEF("size", mgRouterGetSize, NULL)
+};
+
+JSFullClassDef mgRouterClass = {
+    .def = {
+        .class_name = "MongooseRouter",
+        .finalizer = mgRouterFinalizer,
+        .gc_mark = mgRouterGcMark,
+    },
+    .constructor = { NULL, 0 },
+    .funcs_len = sizeof(mgRouterClassFuncs),
+    .funcs = mgRouterClassFuncs
+};
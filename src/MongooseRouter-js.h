@@ -0,0 +1,10 @@
+#ifndef __MONGOOSE_ROUTER_JS_H
+#define __MONGOOSE_ROUTER_JS_H
+
+#include "mongoose.h"
+#include "js-utils.h"
+
+extern JSFullClassDef mgRouterClass;
+JSValue mgRouterCreate(JSContext *ctx);
+
+#endif
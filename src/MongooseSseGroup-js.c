@@ -0,0 +1,275 @@
+#include "MongooseSseGroup-js.h"
+
+#define MG_SSE_DEFAULT_MAX_BUFFERED (1024 * 1024)
+
+typedef struct mgSseMember mgSseMember;
+
+typedef struct {
+    JSContext *ctx;
+    mgSseMember **members;
+    size_t len;
+    size_t cap;
+    size_t maxBuffered;
+} mgSseGroupObj;
+
+// Kept in the subscriber connection's pfn_data, so that it leaves the
+// group in O(1) when it closes. The group may be gone first, see
+// mgSseGroupDetach().
+struct mgSseMember {
+    mgSseGroupObj *group;
+    struct mg_connection *conn;
+    size_t index;
+};
+
+static mgSseGroupObj* getMgSseGroupObj(JSValueConst this_val)
+{
+    return JS_GetOpaque(this_val, mgSseGroupClass.id);
+}
+
+static void mgSseGroupRemove(mgSseMember *m)
+{
+    mgSseGroupObj *group = m->group;
+    if (group == NULL) return;
+    group->members[m->index] = group->members[--group->len];
+    group->members[m->index]->index = m->index;
+}
+
+// Protocol handler of subscribers, replacing http_cb
+static void mgSseConnCb(struct mg_connection *c, int ev, void *ev_data, void *fn_data)
+{
+    mgSseMember *m = fn_data;
+    if (ev == MG_EV_READ)
+        c->recv.len = 0; // Nothing is expected from a subscriber
+    else if (ev == MG_EV_CLOSE)
+    {
+        mgSseGroupRemove(m);
+        free(m);
+        c->pfn_data = NULL;
+    }
+}
+
+// Ends every subscription, the events already queued are still sent
+static void mgSseGroupDetach(mgSseGroupObj *state)
+{
+    for (size_t i = 0; i < state->len; i++)
+    {
+        state->members[i]->group = NULL;
+        state->members[i]->conn->is_draining = 1;
+    }
+    state->len = 0;
+}
+
+static void mgSseGroupFinalizer(JSRuntime *rt, JSValue val)
+{
+    mgSseGroupObj *state = getMgSseGroupObj(val);
+    mgSseGroupDetach(state);
+    free(state->members);
+    js_free(state->ctx, state);
+}
+
+JSValue mgSseGroupCreate(JSContext *ctx, int argc, JSValueConst *argv)
+{
+    JSValue obj;
+    mgSseGroupObj *state;
+    uint64_t maxBuffered = MG_SSE_DEFAULT_MAX_BUFFERED;
+    if (argc > 0 && !JS_IsUndefined(argv[0]) && !JS_IsNull(argv[0]))
+    {
+        int64_t val;
+        if (JS_ToInt64(ctx, &val, argv[0]) != 0) return JS_EXCEPTION;
+        if (val < 0) return JS_ThrowRangeError(ctx, "maxBuffered must not be negative");
+        maxBuffered = (uint64_t) val;
+    }
+    obj = JS_NewObjectClass(ctx, mgSseGroupClass.id);
+    if (JS_IsException(obj)) return obj;
+    state = js_mallocz(ctx, sizeof(*state));
+    if (state == NULL)
+    {
+        JS_FreeValue(ctx, obj);
+        return JS_EXCEPTION;
+    }
+    state->ctx = ctx;
+    state->maxBuffered = (size_t) maxBuffered;
+    JS_SetOpaque(obj, state);
+    return obj;
+}
+
+int mgSseGroupAdd(JSContext *ctx, JSValueConst group, struct mg_connection *c)
+{
+    mgSseGroupObj *state = getMgSseGroupObj(group);
+    mgSseMember *m;
+    if (state == NULL)
+    {
+        JS_ThrowTypeError(ctx, "not a MongooseSseGroup");
+        return -1;
+    }
+    if (state->len == state->cap)
+    {
+        size_t cap = state->cap == 0 ? 16 : state->cap * 2;
+        mgSseMember **members = realloc(state->members, cap * sizeof(*members));
+        if (members == NULL)
+        {
+            JS_ThrowOutOfMemory(ctx);
+            return -1;
+        }
+        state->members = members;
+        state->cap = cap;
+    }
+    if ((m = malloc(sizeof(*m))) == NULL)
+    {
+        JS_ThrowOutOfMemory(ctx);
+        return -1;
+    }
+    m->group = state;
+    m->conn = c;
+    m->index = state->len;
+    state->members[state->len++] = m;
+    c->pfn = mgSseConnCb;
+    c->pfn_data = m;
+    return 0;
+}
+
+// Appends the same bytes to every subscriber. Those that do not read
+// fast enough to stay under maxBuffered are dropped, rather than letting
+// their send buffers grow without bound. Returns the number reached.
+static size_t mgSseGroupSend(mgSseGroupObj *state, const void *buf, size_t len)
+{
+    size_t sent = 0;
+    for (size_t i = 0; i < state->len; i++)
+    {
+        struct mg_connection *c = state->members[i]->conn;
+        if (c->is_closing || c->is_draining) continue;
+        if (state->maxBuffered > 0 && c->send.len > state->maxBuffered)
+        {
+            c->is_closing = 1;
+            continue;
+        }
+        mg_send(c, buf, len);
+        sent++;
+    }
+    return sent;
+}
+
+// Adds "<field>: <line>\n" for every line of the value. CR, LF and CRLF
+// all end a line, as in the event stream format.
+static void appendField(struct mg_iobuf *io, const char *field, const char *p, size_t len)
+{
+    const char *end = p + len;
+    size_t n = strlen(field);
+    for (;;)
+    {
+        const char *eol = p;
+        while (eol < end && *eol != '\r' && *eol != '\n') eol++;
+        mg_iobuf_add(io, io->len, field, n, MG_IO_SIZE);
+        mg_iobuf_add(io, io->len, p, eol - p, MG_IO_SIZE);
+        mg_iobuf_add(io, io->len, "\n", 1, MG_IO_SIZE);
+        if (eol == end) break;
+        if (*eol == '\r' && eol + 1 < end && eol[1] == '\n') eol++;
+        p = eol + 1;
+    }
+}
+
+// Reads an optional single line field, *str is NULL when it is not given
+static int toLineField(JSContext *ctx, int argc, JSValueConst *argv, int i, const char **str, size_t *len)
+{
+    *str = NULL;
+    if (argc <= i || JS_IsUndefined(argv[i]) || JS_IsNull(argv[i])) return 0;
+    if ((*str = JS_ToCStringLen(ctx, len, argv[i])) == NULL) return -1;
+    if (memchr(*str, '\r', *len) != NULL || memchr(*str, '\n', *len) != NULL)
+    {
+        JS_FreeCString(ctx, *str);
+        *str = NULL;
+        JS_ThrowTypeError(ctx, "event name and id must not contain CR or LF");
+        return -1;
+    }
+    return 0;
+}
+
+// broadcast(data, event, id): the event is formatted once, whatever the
+// number of subscribers
+static JSValue mgSseGroupBroadcast(
+    JSContext *ctx, JSValueConst this_val,
+    int argc, JSValueConst *argv)
+{
+    mgSseGroupObj *state = getMgSseGroupObj(this_val);
+    struct mg_iobuf io = { NULL, 0, 0 };
+    const char *data, *event = NULL, *id = NULL;
+    size_t dataLen, eventLen, idLen, sent;
+    if (toLineField(ctx, argc, argv, 1, &event, &eventLen) != 0 ||
+            toLineField(ctx, argc, argv, 2, &id, &idLen) != 0)
+    {
+        JS_FreeCString(ctx, event);
+        return JS_EXCEPTION;
+    }
+    if ((data = JS_ToCStringLen(ctx, &dataLen, argv[0])) == NULL)
+    {
+        JS_FreeCString(ctx, event);
+        JS_FreeCString(ctx, id);
+        return JS_EXCEPTION;
+    }
+    if (event != NULL) appendField(&io, "event: ", event, eventLen);
+    if (id != NULL) appendField(&io, "id: ", id, idLen);
+    appendField(&io, "data: ", data, dataLen);
+    mg_iobuf_add(&io, io.len, "\n", 1, MG_IO_SIZE);
+    sent = mgSseGroupSend(state, io.buf, io.len);
+    mg_iobuf_free(&io);
+    JS_FreeCString(ctx, data);
+    JS_FreeCString(ctx, event);
+    JS_FreeCString(ctx, id);
+    return JS_NewInt64(ctx, (int64_t) sent);
+}
+
+// Comment lines are ignored by clients, an empty one is the heartbeat
+// that keeps idle connections open through proxies
+static JSValue mgSseGroupComment(
+    JSContext *ctx, JSValueConst this_val,
+    int argc, JSValueConst *argv)
+{
+    mgSseGroupObj *state = getMgSseGroupObj(this_val);
+    struct mg_iobuf io = { NULL, 0, 0 };
+    const char *text = NULL;
+    size_t len = 0, sent;
+    if (argc > 0 && !JS_IsUndefined(argv[0]) &&
+            (text = JS_ToCStringLen(ctx, &len, argv[0])) == NULL)
+        return JS_EXCEPTION;
+    if (len == 0)
+        mg_iobuf_add(&io, 0, ":\n", 2, MG_IO_SIZE);
+    else
+        appendField(&io, ": ", text, len);
+    mg_iobuf_add(&io, io.len, "\n", 1, MG_IO_SIZE);
+    sent = mgSseGroupSend(state, io.buf, io.len);
+    mg_iobuf_free(&io);
+    JS_FreeCString(ctx, text);
+    return JS_NewInt64(ctx, (int64_t) sent);
+}
+
+static JSValue mgSseGroupClose(
+    JSContext *ctx, JSValueConst this_val,
+    int argc, JSValueConst *argv)
+{
+    mgSseGroupObj *state = getMgSseGroupObj(this_val);
+    mgSseGroupDetach(state);
+    return JS_UNDEFINED;
+}
+
+static JSValue mgSseGroupGetSize(JSContext *ctx, JSValueConst this_val)
+{
+    mgSseGroupObj *state = getMgSseGroupObj(this_val);
+    return JS_NewInt64(ctx, (int64_t) state->len);
+}
+
+static JSCFunctionListEntry mgSseGroupClassFuncs[] = {
+    JS_CFUNC_DEF("broadcast", 3, mgSseGroupBroadcast),
+    JS_CFUNC_DEF("comment", 1, mgSseGroupComment),
+    JS_CFUNC_DEF("close", 0, mgSseGroupClose),
+    JS_CGETSET_DEF("size", mgSseGroupGetSize, NULL)
+};
+
+JSFullClassDef mgSseGroupClass = {
+    .def = {
+        .class_name = "MongooseSseGroup",
+        .finalizer = mgSseGroupFinalizer,
+    },
+    .constructor = { NULL, 0 },
+    .funcs_len = sizeof(mgSseGroupClassFuncs),
+    .funcs = mgSseGroupClassFuncs
+};
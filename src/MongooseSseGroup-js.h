@@ -0,0 +1,14 @@
+#ifndef __MONGOOSE_SSE_GROUP_JS_H
+#define __MONGOOSE_SSE_GROUP_JS_H
+
+#include "mongoose.h"
+#include "js-utils.h"
+
+extern JSFullClassDef mgSseGroupClass;
+JSValue mgSseGroupCreate(JSContext *ctx, int argc, JSValueConst *argv);
+// Hands an HTTP connection over to the group: it stops parsing requests
+// and receives every event broadcast from then on. Returns -1 with a
+// pending exception if group is not a MongooseSseGroup.
+int mgSseGroupAdd(JSContext *ctx, JSValueConst group, struct mg_connection *c);
+
+#endif
@@ -1,11 +1,17 @@
 #include "MongooseWsMessage-js.h"
 #include "MongooseConnection-js.h"
 
+// The payload is only valid during the event, it lives in the
+// connection's receive buffer, or in a copy for batched events
 typedef struct {
     JSContext *ctx;
+    mgObjPool *pool;
     struct mg_connection *conn;
-    struct mg_ws_message *msg;
-    JSValue jsConnection;
+    struct mg_ws_message *msg;      // NULL once the event is over
+    JSValue jsMessage;              // Zero-copy view, detached by mgWsMsgRelease()
+    JSValue jsConnection;           // Set by mgWsMsgPin(), conn may close first
+    struct mg_ws_message copy;
+    char *pinned;                   // Payload of copy
 } mgWsMsgObj;
 
 static mgWsMsgObj* getMgWsMsgObj(JSValueConst this_val) 
@@ -16,46 +22,143 @@ static mgWsMsgObj* getMgWsMsgObj(JSValueConst this_val)
 static void mgWsMsgFinalizer(JSRuntime *rt, JSValue val) 
 {
     mgWsMsgObj *state = getMgWsMsgObj(val);
+    JS_FreeValueRT(rt, state->jsMessage);
     JS_FreeValueRT(rt, state->jsConnection);
-    js_free(state->ctx, state);
+    js_free_rt(rt, state->pinned);
+    if (state->pool != NULL)
+        mgObjPoolPut(state->pool, state);
+    else
+        js_free(state->ctx, state);
 }
 
 static void mgWsMsgGcMark(JSRuntime *rt, JSValueConst val, JS_MarkFunc *mark_func) 
 {
     mgWsMsgObj *state = getMgWsMsgObj(val);
     if (state) 
+    {
+        JS_MarkValue(rt, state->jsMessage, mark_func);
         JS_MarkValue(rt, state->jsConnection, mark_func);
+    }
+}
+
+mgObjPool *mgWsMsgPoolNew(JSContext *ctx, size_t maxIdle)
+{
+    return mgObjPoolNew(JS_GetRuntime(ctx), sizeof(mgWsMsgObj), maxIdle);
 }
 
-JSValue mgWsMsgCreate(JSContext *ctx, struct mg_connection *conn, struct mg_ws_message *msg)
+JSValue mgWsMsgCreate(JSContext *ctx, mgObjPool *pool, struct mg_connection *conn, struct mg_ws_message *msg)
 {
     JSValue obj = JS_NewObjectClass(ctx, mgWsMsgClass.id);
     mgWsMsgObj *state;
-    state = js_mallocz(ctx, sizeof(*state));
+    if (JS_IsException(obj)) return obj;
+    state = pool != NULL ? mgObjPoolGet(pool) : js_mallocz(ctx, sizeof(*state));
+    if (state == NULL) 
+    {
+        JS_FreeValue(ctx, obj);
+        return JS_ThrowOutOfMemory(ctx);
+    }
     state->ctx = ctx;
+    state->pool = pool;
     state->conn = conn;
     state->msg = msg;
+    state->jsMessage = JS_UNDEFINED;
     state->jsConnection = JS_UNDEFINED;
     JS_SetOpaque(obj, state);
     return obj;
 }
 
+void mgWsMsgPin(JSValueConst obj)
+{
+    mgWsMsgObj *state = getMgWsMsgObj(obj);
+    struct mg_ws_message *msg;
+    if (state == NULL || (msg = state->msg) == NULL || msg == &state->copy) return;
+    state->jsConnection = mgConnGet(state->ctx, state->conn);
+    state->copy = *msg;
+    state->pinned = js_malloc(state->ctx, msg->data.len + 1);
+    if (state->pinned != NULL)
+        memcpy(state->pinned, msg->data.ptr, msg->data.len);
+    else
+        state->copy.data.len = 0;
+    state->copy.data.ptr = state->pinned;
+    state->msg = &state->copy;
+    state->conn = NULL;
+}
+
+void mgWsMsgRelease(JSValueConst obj)
+{
+    mgWsMsgObj *state = getMgWsMsgObj(obj);
+    if (state == NULL || state->msg == NULL) return;
+    if (!JS_IsUndefined(state->jsMessage))
+        JS_DetachArrayBuffer(state->ctx, state->jsMessage);
+    state->msg = NULL;
+    state->conn = NULL;
+    js_free(state->ctx, state->pinned);
+    state->pinned = NULL;
+}
+
+static struct mg_ws_message *getMessage(JSContext *ctx, mgWsMsgObj *state)
+{
+    if (state->msg == NULL)
+        JS_ThrowTypeError(ctx, "the message is only available during its event, use copy() to keep it");
+    return state->msg;
+}
+
+// The same view on every access, it reads zero bytes once detached
 static JSValue mgWsMsgGetMessage(JSContext *ctx, JSValueConst this_val)
 {
     mgWsMsgObj *state = getMgWsMsgObj(this_val);
-    return JS_NewArrayBuffer(ctx, state->msg->data.ptr, state->msg->data.len, NULL, NULL, false);
+    if (JS_IsUndefined(state->jsMessage)) 
+    {
+        struct mg_ws_message *msg = getMessage(ctx, state);
+        if (msg == NULL) return JS_EXCEPTION;
+        state->jsMessage = JS_NewArrayBuffer(ctx, (uint8_t *) msg->data.ptr, msg->data.len,
+            NULL, NULL, false);
+    }
+    return JS_DupValue(ctx, state->jsMessage);
+}
+
+// Decodes the payload as UTF-8 without going through an ArrayBuffer
+static JSValue mgWsMsgGetText(JSContext *ctx, JSValueConst this_val)
+{
+    mgWsMsgObj *state = getMgWsMsgObj(this_val);
+    struct mg_ws_message *msg = getMessage(ctx, state);
+    if (msg == NULL) return JS_EXCEPTION;
+    return JS_NewStringLen(ctx, msg->data.ptr, msg->data.len);
+}
+
+static JSValue mgWsMsgGetIsText(JSContext *ctx, JSValueConst this_val)
+{
+    mgWsMsgObj *state = getMgWsMsgObj(this_val);
+    struct mg_ws_message *msg = getMessage(ctx, state);
+    if (msg == NULL) return JS_EXCEPTION;
+    return JS_NewBool(ctx, (msg->flags & 15) == WEBSOCKET_OP_TEXT);
+}
+
+// An ArrayBuffer of its own, that can be kept after the event
+static JSValue mgWsMsgCopy(
+    JSContext *ctx, JSValueConst this_val,
+    int argc, JSValueConst *argv)
+{
+    mgWsMsgObj *state = getMgWsMsgObj(this_val);
+    struct mg_ws_message *msg = getMessage(ctx, state);
+    if (msg == NULL) return JS_EXCEPTION;
+    return JS_NewArrayBufferCopy(ctx, (const uint8_t *) msg->data.ptr, msg->data.len);
 }
 
 static JSValue mgWsMsgGetConnection(JSContext *ctx, JSValueConst this_val)
 {
     mgWsMsgObj *state = getMgWsMsgObj(this_val);
-    if (JS_IsUndefined(state->jsConnection)) 
-        state->jsConnection = mgConnCreate(ctx, state->conn);
-    return JS_DupValue(ctx, state->jsConnection);
+    if (getMessage(ctx, state) == NULL) return JS_EXCEPTION;
+    if (!JS_IsUndefined(state->jsConnection))
+        return JS_DupValue(ctx, state->jsConnection);
+    return mgConnGet(ctx, state->conn);
 }
 
 static JSCFunctionListEntry mgWsMsgClassFuncs[] = {
     JS_CGETSET_DEF("message", mgWsMsgGetMessage, NULL),
+    JS_CGETSET_DEF("text", mgWsMsgGetText, NULL),
+    JS_CGETSET_DEF("isText", mgWsMsgGetIsText, NULL),
+    JS_CFUNC_DEF("copy", 0, mgWsMsgCopy),
     JS_CGETSET_DEF("connection", mgWsMsgGetConnection, NULL)
 };
 
@@ -3,8 +3,17 @@
 
 #include "mongoose.h"
 #include "js-utils.h"
+#include "object-pool.h"
 
 extern JSFullClassDef mgWsMsgClass;
-JSValue mgWsMsgCreate(JSContext *ctx, struct mg_connection *conn, struct mg_ws_message *msg);
+// The native state comes from pool when not NULL, see mgWsMsgPoolNew()
+JSValue mgWsMsgCreate(JSContext *ctx, mgObjPool *pool, struct mg_connection *conn, struct mg_ws_message *msg);
+mgObjPool *mgWsMsgPoolNew(JSContext *ctx, size_t maxIdle);
+// Copies the payload of a message whose callback runs after its event, see
+// onEventBatch. Does nothing for other values.
+void mgWsMsgPin(JSValueConst obj);
+// Called when the event that created a message ends: its payload view is
+// detached and the message can no longer be read
+void mgWsMsgRelease(JSValueConst obj);
 
 #endif
\ No newline at end of file
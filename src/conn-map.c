@@ -0,0 +1,81 @@
+#include "conn-map.h"
+
+#define MG_CONN_MAP_MIN_CAP 64
+
+static size_t slotOf(const mgConnMap *map, unsigned long id)
+{
+    // Ids are sequential, Fibonacci hashing spreads them
+    return (size_t) (((uint64_t) id * 11400714819323198485ULL) >> 32) & (map->cap - 1);
+}
+
+static void insert(mgConnMap *map, const mgConnMapEntry *e)
+{
+    size_t i = slotOf(map, e->id);
+    while (map->slots[i].id != 0) i = (i + 1) & (map->cap - 1);
+    map->slots[i] = *e;
+    map->len++;
+}
+
+static int grow(mgConnMap *map)
+{
+    size_t cap = map->cap == 0 ? MG_CONN_MAP_MIN_CAP : map->cap * 2;
+    mgConnMapEntry *old = map->slots;
+    size_t oldCap = map->cap;
+    if ((map->slots = calloc(cap, sizeof(*map->slots))) == NULL)
+    {
+        map->slots = old;
+        return -1;
+    }
+    map->cap = cap;
+    map->len = 0;
+    for (size_t i = 0; i < oldCap; i++)
+        if (old[i].id != 0) insert(map, &old[i]);
+    free(old);
+    return 0;
+}
+
+mgConnMapEntry *mgConnMapGet(mgConnMap *map, unsigned long id)
+{
+    size_t i;
+    if (map->cap == 0 || id == 0) return NULL;
+    for (i = slotOf(map, id); map->slots[i].id != 0; i = (i + 1) & (map->cap - 1))
+        if (map->slots[i].id == id) return &map->slots[i];
+    return NULL;
+}
+
+mgConnMapEntry *mgConnMapPut(mgConnMap *map, struct mg_connection *c)
+{
+    mgConnMapEntry e = { c->id, c, NULL }, *res = mgConnMapGet(map, c->id);
+    if (res != NULL) return res;
+    // At most half full, so that probe sequences stay short
+    if ((map->len + 1) * 2 > map->cap && grow(map) != 0) return NULL;
+    insert(map, &e);
+    return mgConnMapGet(map, c->id);
+}
+
+void mgConnMapRemove(mgConnMap *map, unsigned long id)
+{
+    mgConnMapEntry *e = mgConnMapGet(map, id);
+    size_t i, j;
+    if (e == NULL) return;
+    // Backward shift deletion: later entries of the probe sequence move
+    // into the hole, no tombstones are needed
+    i = (size_t) (e - map->slots);
+    for (j = (i + 1) & (map->cap - 1); map->slots[j].id != 0; j = (j + 1) & (map->cap - 1))
+    {
+        size_t home = slotOf(map, map->slots[j].id);
+        // Whether home lies cyclically in (i, j], then the entry stays
+        bool stays = i <= j ? (i < home && home <= j) : (i < home || home <= j);
+        if (stays) continue;
+        map->slots[i] = map->slots[j];
+        i = j;
+    }
+    memset(&map->slots[i], 0, sizeof(map->slots[i]));
+    map->len--;
+}
+
+void mgConnMapFree(mgConnMap *map)
+{
+    free(map->slots);
+    memset(map, 0, sizeof(*map));
+}
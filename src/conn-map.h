@@ -0,0 +1,26 @@
+#ifndef QJS_CONN_MAP_H
+#define QJS_CONN_MAP_H
+
+#include "mongoose.h"
+
+// Open addressing table of a manager's connections by id, with the JS
+// handle of each one once it has been created
+typedef struct {
+    unsigned long id;   // 0 for free slots, mongoose ids start at 1
+    struct mg_connection *conn;
+    void *handle;
+} mgConnMapEntry;
+
+typedef struct {
+    mgConnMapEntry *slots;
+    size_t cap;         // A power of 2
+    size_t len;
+} mgConnMap;
+
+mgConnMapEntry *mgConnMapGet(mgConnMap *map, unsigned long id);
+// Returns the existing entry of c if any, NULL when out of memory
+mgConnMapEntry *mgConnMapPut(mgConnMap *map, struct mg_connection *c);
+void mgConnMapRemove(mgConnMap *map, unsigned long id);
+void mgConnMapFree(mgConnMap *map);
+
+#endif
@@ -0,0 +1,216 @@
+#include "http-compress.h"
+#include <zlib.h>
+#ifdef MG_ENABLE_BROTLI
+#include <brotli/encode.h>
+#endif
+
+// Output space reserved per deflate/brotli round
+#define MG_COMPRESS_CHUNK 16384
+
+struct mgCompressStream {
+    int encoding;
+    z_stream z;
+#ifdef MG_ENABLE_BROTLI
+    BrotliEncoderState *br;
+#endif
+};
+
+static bool isZeroQuality(const char *p, const char *end)
+{
+    while (p < end && *p == ' ') p++;
+    if (end - p < 2 || (p[0] != 'q' && p[0] != 'Q') || p[1] != '=') return false;
+    p += 2;
+    if (p >= end || *p != '0') return false;
+    for (p++; p < end && (*p == '.' || *p == '0'); p++);
+    return p == end || *p == ' ' || *p == ';';
+}
+
+int mgCompressNegotiate(struct mg_str *acceptEncoding, bool brotli)
+{
+    bool accepted[MG_ENCODING_DEFLATE + 1] = { false };
+    bool listed[MG_ENCODING_DEFLATE + 1] = { false };
+    bool wildcard = false, anyAccepted = false;
+    const char *p, *end;
+    if (acceptEncoding == NULL) return MG_ENCODING_IDENTITY;
+    p = acceptEncoding->ptr;
+    end = p + acceptEncoding->len;
+    while (p < end)
+    {
+        const char *tok = p, *params, *next;
+        size_t n;
+        int enc = -1;
+        bool ok;
+        for (next = p; next < end && *next != ','; next++);
+        for (params = tok; params < next && *params != ';'; params++);
+        while (tok < params && *tok == ' ') tok++;
+        for (n = params - tok; n > 0 && tok[n - 1] == ' '; n--);
+        if (n == 2 && mg_ncasecmp(tok, "br", 2) == 0) enc = MG_ENCODING_BROTLI;
+        else if (n == 4 && mg_ncasecmp(tok, "gzip", 4) == 0) enc = MG_ENCODING_GZIP;
+        else if (n == 7 && mg_ncasecmp(tok, "deflate", 7) == 0) enc = MG_ENCODING_DEFLATE;
+        ok = params == next || !isZeroQuality(params + 1, next);
+        if (n == 1 && *tok == '*')
+        {
+            wildcard = true;
+            anyAccepted = ok;
+        }
+        else if (enc >= 0)
+        {
+            listed[enc] = true;
+            accepted[enc] = ok;
+        }
+        p = next + 1;
+    }
+    // "*" only stands for the codings the header does not name. Brotli is
+    // left out, it is only used when asked for by name.
+    if (wildcard)
+    {
+        if (!listed[MG_ENCODING_GZIP]) accepted[MG_ENCODING_GZIP] = anyAccepted;
+        if (!listed[MG_ENCODING_DEFLATE]) accepted[MG_ENCODING_DEFLATE] = anyAccepted;
+    }
+#ifdef MG_ENABLE_BROTLI
+    if (brotli && accepted[MG_ENCODING_BROTLI]) return MG_ENCODING_BROTLI;
+#else
+    (void) brotli;
+#endif
+    if (accepted[MG_ENCODING_GZIP]) return MG_ENCODING_GZIP;
+    if (accepted[MG_ENCODING_DEFLATE]) return MG_ENCODING_DEFLATE;
+    return MG_ENCODING_IDENTITY;
+}
+
+const char *mgCompressEncodingName(int encoding)
+{
+    switch (encoding)
+    {
+        case MG_ENCODING_BROTLI:
+            return "br";
+        case MG_ENCODING_GZIP:
+            return "gzip";
+        case MG_ENCODING_DEFLATE:
+            return "deflate";
+        default:
+            return "identity";
+    }
+}
+
+static bool hasPrefix(struct mg_str *s, const char *prefix)
+{
+    size_t n = strlen(prefix);
+    return s->len >= n && mg_ncasecmp(s->ptr, prefix, n) == 0;
+}
+
+bool mgCompressibleType(struct mg_str *contentType)
+{
+    if (contentType == NULL || contentType->len == 0) return true;
+    if (hasPrefix(contentType, "image/svg")) return true;
+    return !hasPrefix(contentType, "image/") &&
+        !hasPrefix(contentType, "audio/") &&
+        !hasPrefix(contentType, "video/") &&
+        !hasPrefix(contentType, "font/woff") &&
+        !hasPrefix(contentType, "application/zip") &&
+        !hasPrefix(contentType, "application/gzip") &&
+        !hasPrefix(contentType, "application/octet-stream");
+}
+
+mgCompressStream *mgCompressStreamNew(int encoding, int level)
+{
+    mgCompressStream *s = calloc(1, sizeof(*s));
+    if (s == NULL) return NULL;
+    s->encoding = encoding;
+    if (level < 1) level = 1;
+#ifdef MG_ENABLE_BROTLI
+    if (encoding == MG_ENCODING_BROTLI)
+    {
+        s->br = BrotliEncoderCreateInstance(NULL, NULL, NULL);
+        if (s->br != NULL) {
+            BrotliEncoderSetParameter(s->br, BROTLI_PARAM_QUALITY,
+                level > BROTLI_MAX_QUALITY ? BROTLI_MAX_QUALITY : level);
+            return s;
+        }
+        free(s);
+        return NULL;
+    }
+#endif
+    if (encoding != MG_ENCODING_GZIP && encoding != MG_ENCODING_DEFLATE)
+    {
+        free(s);
+        return NULL;
+    }
+    // 15 bits window, +16 selects the gzip wrapper instead of zlib
+    if (level > Z_BEST_COMPRESSION) level = Z_BEST_COMPRESSION;
+    if (deflateInit2(&s->z, level, Z_DEFLATED,
+            encoding == MG_ENCODING_GZIP ? 15 + 16 : 15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+    {
+        free(s);
+        return NULL;
+    }
+    return s;
+}
+
+static bool reserveOutput(struct mg_iobuf *out)
+{
+    if (out->size - out->len >= MG_COMPRESS_CHUNK) return true;
+    mg_iobuf_resize(out, out->len + MG_COMPRESS_CHUNK);
+    return out->size - out->len >= MG_COMPRESS_CHUNK;
+}
+
+#ifdef MG_ENABLE_BROTLI
+static int brotliWrite(mgCompressStream *s, const void *in, size_t len, bool finish, struct mg_iobuf *out)
+{
+    BrotliEncoderOperation op = finish ? BROTLI_OPERATION_FINISH : BROTLI_OPERATION_FLUSH;
+    const uint8_t *next_in = in;
+    size_t avail_in = len;
+    do {
+        uint8_t *next_out;
+        size_t avail_out;
+        if (!reserveOutput(out)) return -1;
+        next_out = out->buf + out->len;
+        avail_out = out->size - out->len;
+        if (!BrotliEncoderCompressStream(s->br, op, &avail_in, &next_in, &avail_out, &next_out, NULL))
+            return -1;
+        out->len = out->size - avail_out;
+    } while (avail_in > 0 || BrotliEncoderHasMoreOutput(s->br) ||
+             (finish && !BrotliEncoderIsFinished(s->br)));
+    return 0;
+}
+#endif
+
+int mgCompressStreamWrite(mgCompressStream *s, const void *in, size_t len, bool finish, struct mg_iobuf *out)
+{
+    int ret;
+#ifdef MG_ENABLE_BROTLI
+    if (s->encoding == MG_ENCODING_BROTLI)
+        return brotliWrite(s, in, len, finish, out);
+#endif
+    s->z.next_in = (Bytef *) in;
+    s->z.avail_in = (uInt) len;
+    do {
+        if (!reserveOutput(out)) return -1;
+        s->z.next_out = out->buf + out->len;
+        s->z.avail_out = (uInt) (out->size - out->len);
+        ret = deflate(&s->z, finish ? Z_FINISH : Z_SYNC_FLUSH);
+        out->len = out->size - s->z.avail_out;
+        if (ret == Z_STREAM_ERROR) return -1;
+    } while (s->z.avail_out == 0 || (finish && ret != Z_STREAM_END));
+    return 0;
+}
+
+void mgCompressStreamFree(mgCompressStream *s)
+{
+    if (s == NULL) return;
+#ifdef MG_ENABLE_BROTLI
+    if (s->br != NULL) BrotliEncoderDestroyInstance(s->br);
+    if (s->encoding != MG_ENCODING_BROTLI)
+#endif
+    deflateEnd(&s->z);
+    free(s);
+}
+
+int mgCompressBuffer(int encoding, int level, const void *in, size_t len, struct mg_iobuf *out)
+{
+    mgCompressStream *s = mgCompressStreamNew(encoding, level);
+    int ret;
+    if (s == NULL) return -1;
+    ret = mgCompressStreamWrite(s, in, len, true, out);
+    mgCompressStreamFree(s);
+    return ret;
+}
@@ -0,0 +1,42 @@
+#ifndef QJS_HTTP_COMPRESS_H
+#define QJS_HTTP_COMPRESS_H
+
+#include "mongoose.h"
+
+// Content codings, in order of preference
+enum {
+    MG_ENCODING_IDENTITY,
+    MG_ENCODING_BROTLI,
+    MG_ENCODING_GZIP,
+    MG_ENCODING_DEFLATE,
+};
+
+#define MG_COMPRESS_DEFAULT_LEVEL 6
+#define MG_COMPRESS_DEFAULT_MIN_SIZE 1024
+
+// Compression settings of a listener. A level of 0 disables compression.
+typedef struct {
+    int level;
+    size_t minSize;
+    bool brotli;
+} mgCompressOpts;
+
+typedef struct mgCompressStream mgCompressStream;
+
+// Picks the preferred coding the client accepts, honouring q=0
+int mgCompressNegotiate(struct mg_str *acceptEncoding, bool brotli);
+const char *mgCompressEncodingName(int encoding);
+// Checks the Content-Type of a response; already compressed media
+// (images, audio, video, archives) is not worth compressing again
+bool mgCompressibleType(struct mg_str *contentType);
+
+// Compresses a whole body into out. Returns -1 on error.
+int mgCompressBuffer(int encoding, int level, const void *in, size_t len, struct mg_iobuf *out);
+
+// Streaming compression for chunked responses: every write is flushed, so
+// each chunk can be decoded as soon as it arrives.
+mgCompressStream *mgCompressStreamNew(int encoding, int level);
+int mgCompressStreamWrite(mgCompressStream *s, const void *in, size_t len, bool finish, struct mg_iobuf *out);
+void mgCompressStreamFree(mgCompressStream *s);
+
+#endif
@@ -30,4 +30,62 @@ uint32_t JS_GetArrayLength(JSContext *ctx, JSValue array) {
     JS_ToUint32(ctx, &res, len);
     JS_FreeValue(ctx, len);
     return res;
+}
+
+int JS_GetOptionalIndexProp(JSContext *ctx, JSValueConst obj, const char *prop, uint64_t *res) {
+    JSValue val;
+    int status = 0;
+    if (!JS_IsObject(obj)) return 0;
+    val = JS_GetPropertyStr(ctx, obj, prop);
+    if (JS_IsException(val)) return -1;
+    if (!JS_IsUndefined(val) && !JS_IsNull(val))
+        status = JS_ToIndex(ctx, res, val);
+    JS_FreeValue(ctx, val);
+    return status;
+}
+
+static void JS_DiscardException(JSContext *ctx) {
+    JS_FreeValue(ctx, JS_GetException(ctx));
+}
+
+int JS_GetBytes(JSContext *ctx, JSValueConst val, JSBytes *res) {
+    size_t offset, size;
+    memset(res, 0, sizeof(*res));
+    res->buffer = JS_UNDEFINED;
+    if (JS_IsUndefined(val)) return 0;
+    if (JS_IsObject(val)) {
+        uint8_t *buf = JS_GetArrayBuffer(ctx, &size, val);
+        if (buf != NULL) {
+            res->ptr = buf;
+            res->len = size;
+            return 0;
+        }
+        JS_DiscardException(ctx);
+        res->buffer = JS_GetTypedArrayBuffer(ctx, val, &offset, &size, NULL);
+        if (!JS_IsException(res->buffer)) {
+            size_t bufSize;
+            buf = JS_GetArrayBuffer(ctx, &bufSize, res->buffer);
+            if (buf == NULL) { // Detached
+                JS_FreeValue(ctx, res->buffer);
+                res->buffer = JS_UNDEFINED;
+                return -1;
+            }
+            res->ptr = buf + offset;
+            res->len = size;
+            return 0;
+        }
+        res->buffer = JS_UNDEFINED;
+        JS_DiscardException(ctx);
+    }
+    res->cstr = JS_ToCStringLen(ctx, &res->len, val);
+    if (res->cstr == NULL) return -1;
+    res->ptr = (const uint8_t *) res->cstr;
+    return 0;
+}
+
+void JS_FreeBytes(JSContext *ctx, JSBytes *bytes) {
+    if (bytes->cstr != NULL) JS_FreeCString(ctx, bytes->cstr);
+    JS_FreeValue(ctx, bytes->buffer);
+    memset(bytes, 0, sizeof(*bytes));
+    bytes->buffer = JS_UNDEFINED;
 }
\ No newline at end of file
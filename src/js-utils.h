@@ -24,9 +24,25 @@ typedef struct JSFullClassDef_s
     JSCFunctionListEntry *funcs;
 } JSFullClassDef;
 
+// Raw bytes of a string, ArrayBuffer or typed array, see JS_GetBytes()
+typedef struct JSBytes_s {
+    const uint8_t *ptr;
+    size_t len;
+    const char *cstr;
+    JSValue buffer;
+} JSBytes;
+
 int initFullClass(JSContext *ctx, JSModuleDef *m, JSFullClassDef *fullDef);
 int initFullSubClass(JSContext *ctx, JSModuleDef *m, JSFullClassDef *fullDef, JSClassID baseClass);
 void JS_CopyToCStringMax(JSContext *ctx, JSValue val, char* dest, size_t max_len);
 uint32_t JS_GetArrayLength(JSContext *ctx, JSValue array);
+// Reads an optional non-negative integer option, *res is left untouched
+// when the property is missing. Returns -1 with a pending exception on error.
+int JS_GetOptionalIndexProp(JSContext *ctx, JSValueConst obj, const char *prop, uint64_t *res);
+// Borrows the bytes of an ArrayBuffer or typed array without copying them.
+// Other values are converted to a UTF-8 string, undefined gives no bytes.
+// Release with JS_FreeBytes(). Returns -1 with a pending exception on error.
+int JS_GetBytes(JSContext *ctx, JSValueConst val, JSBytes *res);
+void JS_FreeBytes(JSContext *ctx, JSBytes *bytes);
 
 #endif
\ No newline at end of file
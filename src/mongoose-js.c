@@ -4,16 +4,24 @@
 #include "MongooseConnection-js.h"
 #include "MongooseMqttClient-js.h"
 #include "MongooseHttpMessage-js.h"
+#include "MongooseHttpHeaders-js.h"
+#include "MongooseResponseHeaders-js.h"
 #include "MongooseWsMessage-js.h"
 #include "MongooseMqttMessage-js.h"
+#include "MongooseSseGroup-js.h"
+#include "MongooseRouter-js.h"
 
 static int init(JSContext *ctx, JSModuleDef *m) {
     initFullClass(ctx, m, &mgMgrClass);
     initFullClass(ctx, m, &mgHttpMsgClass);
+    initFullClass(ctx, m, &mgHttpHeadersClass);
+    initFullClass(ctx, m, &mgRespHeadersClass);
     initFullClass(ctx, m, &mgWsMsgClass);
     initFullClass(ctx, m, &mgConnClass);
     initFullClass(ctx, m, &mgMqttClientClass);
     initFullClass(ctx, m, &mgMqttMsgClass);
+    initFullClass(ctx, m, &mgSseGroupClass);
+    initFullClass(ctx, m, &mgRouterClass);
     return 0;
 }
 
@@ -1280,28 +1280,214 @@ void mg_http_write_chunk(struct mg_connection *c, const char *buf, size_t len) {
 }
 
 // clang-format off
-static const char *mg_http_status_code_str(int status_code) {
+#define MG_HTTP_STATUS_LINE(code, reason) \
+  case code: return mg_str_n("HTTP/1.1 " #code " " reason "\r\n", \
+                             sizeof("HTTP/1.1 " #code " " reason "\r\n") - 1)
+
+// Pre-rendered status lines, so replies copy them instead of formatting
+static struct mg_str mg_http_status_line(int status_code) {
   switch (status_code) {
-    case 100: return "Continue";
-    case 201: return "Created";
-    case 202: return "Accepted";
-    case 204: return "No Content";
-    case 206: return "Partial Content";
-    case 301: return "Moved Permanently";
-    case 302: return "Found";
-    case 304: return "Not Modified";
-    case 400: return "Bad Request";
-    case 401: return "Unauthorized";
-    case 403: return "Forbidden";
-    case 404: return "Not Found";
-    case 418: return "I'm a teapot";
-    case 500: return "Internal Server Error";
-    case 501: return "Not Implemented";
-    default: return "OK";
+    MG_HTTP_STATUS_LINE(100, "Continue");
+    MG_HTTP_STATUS_LINE(101, "Switching Protocols");
+    MG_HTTP_STATUS_LINE(200, "OK");
+    MG_HTTP_STATUS_LINE(201, "Created");
+    MG_HTTP_STATUS_LINE(202, "Accepted");
+    MG_HTTP_STATUS_LINE(204, "No Content");
+    MG_HTTP_STATUS_LINE(206, "Partial Content");
+    MG_HTTP_STATUS_LINE(301, "Moved Permanently");
+    MG_HTTP_STATUS_LINE(302, "Found");
+    MG_HTTP_STATUS_LINE(303, "See Other");
+    MG_HTTP_STATUS_LINE(304, "Not Modified");
+    MG_HTTP_STATUS_LINE(307, "Temporary Redirect");
+    MG_HTTP_STATUS_LINE(308, "Permanent Redirect");
+    MG_HTTP_STATUS_LINE(400, "Bad Request");
+    MG_HTTP_STATUS_LINE(401, "Unauthorized");
+    MG_HTTP_STATUS_LINE(403, "Forbidden");
+    MG_HTTP_STATUS_LINE(404, "Not Found");
+    MG_HTTP_STATUS_LINE(405, "Method Not Allowed");
+    MG_HTTP_STATUS_LINE(408, "Request Timeout");
+    MG_HTTP_STATUS_LINE(409, "Conflict");
+    MG_HTTP_STATUS_LINE(411, "Length Required");
+    MG_HTTP_STATUS_LINE(412, "Precondition Failed");
+    MG_HTTP_STATUS_LINE(413, "Payload Too Large");
+    MG_HTTP_STATUS_LINE(415, "Unsupported Media Type");
+    MG_HTTP_STATUS_LINE(416, "Range Not Satisfiable");
+    MG_HTTP_STATUS_LINE(418, "I'm a teapot");
+    MG_HTTP_STATUS_LINE(422, "Unprocessable Entity");
+    MG_HTTP_STATUS_LINE(429, "Too Many Requests");
+    MG_HTTP_STATUS_LINE(431, "Request Header Fields Too Large");
+    MG_HTTP_STATUS_LINE(500, "Internal Server Error");
+    MG_HTTP_STATUS_LINE(501, "Not Implemented");
+    MG_HTTP_STATUS_LINE(502, "Bad Gateway");
+    MG_HTTP_STATUS_LINE(503, "Service Unavailable");
+    MG_HTTP_STATUS_LINE(504, "Gateway Timeout");
+    default: return mg_str_n(NULL, 0);
   }
 }
 // clang-format on
 
+static const char *mg_http_months[] = {"Jan", "Feb", "Mar", "Apr",
+                                       "May", "Jun", "Jul", "Aug",
+                                       "Sep", "Oct", "Nov", "Dec"};
+
+size_t mg_http_date(char *buf, size_t len, time_t t) {
+  static const char *days[] = {"Sun", "Mon", "Tue", "Wed",
+                               "Thu", "Fri", "Sat"};
+  struct tm *tm = gmtime(&t);
+  if (tm == NULL) return 0;
+  return mg_snprintf(buf, len, "%s, %02d %s %d %02d:%02d:%02d GMT",
+                     days[tm->tm_wday], tm->tm_mday,
+                     mg_http_months[tm->tm_mon], tm->tm_year + 1900,
+                     tm->tm_hour, tm->tm_min, tm->tm_sec);
+}
+
+// Parse an IMF-fixdate, e.g. "Sun, 06 Nov 1994 08:49:37 GMT". The obsolete
+// RFC 850 and asctime formats are not accepted. Returns 0 on error.
+static time_t mg_http_parse_date(struct mg_str s) {
+  char mon[4] = "";
+  int d = 0, y = 0, h = 0, m = 0, sec = 0, i, n = 0;
+  int64_t days;
+  char buf[40];
+  if (s.len >= sizeof(buf)) return 0;
+  memcpy(buf, s.ptr, s.len);
+  buf[s.len] = '\0';
+  if (sscanf(buf, "%*3s, %2d %3s %4d %2d:%2d:%2d GMT%n", &d, mon, &y, &h, &m,
+             &sec, &n) != 6 || n == 0)
+    return 0;
+  for (i = 0; i < 12 && strcmp(mon, mg_http_months[i]) != 0; i++) (void) 0;
+  if (i == 12 || d < 1 || d > 31 || y < 1970 || h > 23 || m > 59 || sec > 60)
+    return 0;
+  // Days since the epoch of a proleptic Gregorian date, March-based year
+  {
+    int yy = i < 2 ? y - 1 : y, mm = i < 2 ? i + 10 : i - 2;
+    int era = yy / 400, yoe = yy - era * 400;
+    int doy = (153 * mm + 2) / 5 + d - 1;
+    int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    days = (int64_t) era * 146097 + doe - 719468;
+  }
+  return (time_t) (days * 86400 + h * 3600 + m * 60 + sec);
+}
+
+// Compare two entity tags, ignoring the weak "W/" prefix
+static bool mg_http_etag_match(struct mg_str a, struct mg_str b) {
+  if (a.len > 2 && a.ptr[0] == 'W' && a.ptr[1] == '/') a.ptr += 2, a.len -= 2;
+  if (b.len > 2 && b.ptr[0] == 'W' && b.ptr[1] == '/') b.ptr += 2, b.len -= 2;
+  return mg_strcmp(a, b) == 0;
+}
+
+bool mg_http_is_fresh(struct mg_http_message *hm, const char *etag,
+                      time_t mtime) {
+  struct mg_str *inm = mg_http_get_header(hm, "If-None-Match");
+  struct mg_str *ims = mg_http_get_header(hm, "If-Modified-Since");
+  if (inm != NULL) {
+    // If-None-Match takes precedence, If-Modified-Since is then ignored
+    size_t i = 0, j;
+    while (etag != NULL && i < inm->len) {
+      struct mg_str k;
+      for (j = i; j < inm->len && inm->ptr[j] != ','; j++) (void) 0;
+      k = mg_str_n(&inm->ptr[i], j - i);
+      while (k.len > 0 && k.ptr[0] == ' ') k.ptr++, k.len--;
+      while (k.len > 0 && k.ptr[k.len - 1] == ' ') k.len--;
+      if (mg_vcmp(&k, "*") == 0 || mg_http_etag_match(k, mg_str(etag)))
+        return true;
+      i = j + 1;
+    }
+    return false;
+  }
+  if (ims != NULL && mtime > 0) {
+    time_t since = mg_http_parse_date(*ims);
+    return since > 0 && mtime <= since;
+  }
+  return false;
+}
+
+// Returns the "Date: ...\r\n" header, rendered at most once per second
+struct mg_str mg_http_date_header(struct mg_mgr *mgr) {
+  time_t now = time(NULL);
+  if (now != mgr->http_date_time || mgr->http_date[0] == '\0') {
+    char date[40];
+    if (mg_http_date(date, sizeof(date), now) == 0) return mg_str_n(NULL, 0);
+    mg_snprintf(mgr->http_date, sizeof(mgr->http_date), "Date: %s\r\n", date);
+    mgr->http_date_time = now;
+  }
+  return mg_str(mgr->http_date);
+}
+
+void mg_http_set_server(struct mg_mgr *mgr, const char *name) {
+  free(mgr->http_server);
+  mgr->http_server = NULL;
+  if (name != NULL && name[0] != '\0') {
+    mg_asprintf(&mgr->http_server, 0, "Server: %s\r\n", name);
+  }
+}
+
+// Check whether the user-supplied header block already has a given header
+static bool mg_http_has_header(const char *headers, struct mg_str name) {
+  const char *p = headers;
+  while (p != NULL && *p != '\0') {
+    if (mg_ncasecmp(p, name.ptr, name.len) == 0 && p[name.len] == ':')
+      return true;
+    if ((p = strchr(p, '\n')) != NULL) p++;
+  }
+  return false;
+}
+
+// Append the status line followed by the Date and Server headers. Known
+// status lines and the cached headers are copied, not formatted.
+static void mg_http_write_status(struct mg_connection *c, int code,
+                                 const char *headers) {
+  struct mg_str line = mg_http_status_line(code), date = mg_str_n(NULL, 0);
+  char buf[50];
+  if (line.ptr == NULL) {
+    size_t n = mg_snprintf(buf, sizeof(buf), "HTTP/1.1 %d OK\r\n", code);
+    line = mg_str_n(buf, n);
+  }
+  mg_send(c, line.ptr, line.len);
+  if (!mg_http_has_header(headers, mg_str("Date")))
+    date = mg_http_date_header(c->mgr);
+  if (date.len > 0) mg_send(c, date.ptr, date.len);
+  if (c->mgr->http_server != NULL &&
+      !mg_http_has_header(headers, mg_str("Server")))
+    mg_send(c, c->mgr->http_server, strlen(c->mgr->http_server));
+}
+
+// Headers and body are copied as is, only Content-Length is formatted.
+// The send buffer grows at most once.
+void mg_http_reply_buf(struct mg_connection *c, int code, const char *headers,
+                       const void *body, size_t len) {
+  char cl[50];
+  size_t hl = headers == NULL ? 0 : strlen(headers);
+  size_t cll = mg_snprintf(cl, sizeof(cl), "Content-Length: %lu\r\n\r\n",
+                           (unsigned long) len);
+  size_t sl = 50 + sizeof(c->mgr->http_date) +
+              (c->mgr->http_server ? strlen(c->mgr->http_server) : 0);
+  size_t need = c->send.len + sl + hl + cll + len;
+  if (c->send.size < need) mg_iobuf_resize(&c->send, need);
+  mg_http_write_status(c, code, headers);
+  if (hl > 0) mg_send(c, headers, hl);
+  mg_send(c, cl, cll);
+  if (len > 0) mg_send(c, body, len);
+}
+
+// Status line and headers only, for replies whose body framing is given by
+// the caller's headers, e.g. "Transfer-Encoding: chunked\r\n"
+void mg_http_write_head(struct mg_connection *c, int code,
+                        const char *headers) {
+  mg_http_write_status(c, code, headers);
+  if (headers != NULL) mg_send(c, headers, strlen(headers));
+  mg_send(c, "\r\n", 2);
+}
+
+// Clears is_paused, and handles the requests buffered in the meantime.
+// Paused connections are also full: nothing more is read meanwhile.
+void mg_http_resume(struct mg_connection *c) {
+  size_t n = 0;
+  if (!c->is_paused) return;
+  c->is_paused = 0;
+  c->is_full = 0;
+  if (c->recv.len > 0) mg_call(c, MG_EV_READ, &n);
+}
+
 void mg_http_reply(struct mg_connection *c, int code, const char *headers,
                    const char *fmt, ...) {
   char mem[256], *buf = mem;
@@ -1310,9 +1496,7 @@ void mg_http_reply(struct mg_connection *c, int code, const char *headers,
   va_start(ap, fmt);
   len = mg_vasprintf(&buf, sizeof(mem), fmt, ap);
   va_end(ap);
-  mg_printf(c, "HTTP/1.1 %d %s\r\n%sContent-Length: %d\r\n\r\n", code,
-            mg_http_status_code_str(code), headers == NULL ? "" : headers, len);
-  mg_send(c, buf, len > 0 ? len : 0);
+  mg_http_reply_buf(c, code, headers, buf, len);
   if (buf != mem) free(buf);
 }
 
@@ -1321,6 +1505,329 @@ static void restore_http_cb(struct mg_connection *c) {
   mg_fs_close((struct mg_fd *) c->pfn_data);
   c->pfn_data = NULL;
   c->pfn = http_cb;
+  // The body is sent, the requests pipelined behind it can go on
+  if (!c->is_closing && !c->is_draining) mg_http_resume(c);
+}
+
+#if MG_ENABLE_INOTIFY
+#include <sys/inotify.h>
+#endif
+
+// A direct-mapped cache of fs->st() results and content types, so that
+// hot static files are served without metadata syscalls. Missing files
+// are cached as well, they are probed for index and precompressed files.
+struct mg_stat_entry {
+  char *path;          // Resolved path, NULL for an empty slot
+  struct mg_fs *fs;    // Filesystem the path belongs to
+  uint32_t hash;       // Hash of path
+  int flags;           // fs->st() result, 0 if the file does not exist
+  size_t size;         // File size
+  time_t mtime;        // Modification time
+  struct mg_str mime;  // Content type from the built-in table, if known
+  uint64_t expire;     // mg_millis() deadline, 0 if watched or no TTL
+};
+
+struct mg_stat_cache {
+  struct mg_stat_entry *entries;
+  size_t len;    // Number of slots
+  uint64_t ttl;  // Lifetime of entries not watched by inotify, 0 is forever
+  int ifd;       // inotify descriptor, or -1
+};
+
+static void mg_stat_cache_clear(struct mg_stat_cache *sc) {
+  size_t i;
+  for (i = 0; i < sc->len; i++) {
+    free(sc->entries[i].path);
+    sc->entries[i].path = NULL;
+  }
+}
+
+void mg_stat_cache_free(struct mg_mgr *mgr) {
+  struct mg_stat_cache *sc = mgr->stat_cache;
+  if (sc == NULL) return;
+  mg_stat_cache_clear(sc);
+#if MG_ENABLE_INOTIFY
+  if (sc->ifd >= 0) close(sc->ifd);
+#endif
+  free(sc->entries);
+  free(sc);
+  mgr->stat_cache = NULL;
+}
+
+bool mg_stat_cache_init(struct mg_mgr *mgr, size_t entries, uint64_t ttl_ms) {
+  struct mg_stat_cache *sc;
+  mg_stat_cache_free(mgr);
+  if (entries == 0) return true;
+  if ((sc = (struct mg_stat_cache *) calloc(1, sizeof(*sc))) == NULL ||
+      (sc->entries = (struct mg_stat_entry *) calloc(
+           entries, sizeof(*sc->entries))) == NULL) {
+    free(sc);
+    return false;
+  }
+  sc->len = entries;
+  sc->ttl = ttl_ms;
+  sc->ifd = -1;
+#if MG_ENABLE_INOTIFY
+  sc->ifd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+  mgr->stat_cache = sc;
+  return true;
+}
+
+// Called on every poll. Changes are rare compared to cache hits, so any
+// event drops the whole cache rather than tracking watches per entry.
+void mg_stat_cache_poll(struct mg_mgr *mgr);
+void mg_stat_cache_poll(struct mg_mgr *mgr) {
+#if MG_ENABLE_INOTIFY
+  struct mg_stat_cache *sc = mgr->stat_cache;
+  char buf[4096];
+  bool changed = false;
+  if (sc == NULL || sc->ifd < 0) return;
+  while (read(sc->ifd, buf, sizeof(buf)) > 0) changed = true;
+  if (changed) mg_stat_cache_clear(sc);
+#else
+  (void) mgr;
+#endif
+}
+
+// Watch the directory of a cached path. Returns false if it cannot be
+// watched, in which case the entry falls back to the TTL.
+static bool mg_stat_cache_watch(struct mg_stat_cache *sc, struct mg_fs *fs,
+                                const char *path) {
+#if MG_ENABLE_INOTIFY
+  char dir[MG_PATH_MAX];
+  const char *slash = strrchr(path, '/');
+  size_t n = slash == NULL ? 0 : (size_t) (slash - path);
+  if (sc->ifd < 0 || fs != &mg_fs_posix || n >= sizeof(dir)) return false;
+  if (n == 0) {
+    dir[n++] = slash == NULL ? '.' : '/';
+  } else {
+    memcpy(dir, path, n);
+  }
+  dir[n] = '\0';
+  return inotify_add_watch(sc->ifd, dir,
+                           IN_MODIFY | IN_ATTRIB | IN_CREATE | IN_DELETE |
+                               IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF |
+                               IN_MOVE_SELF) >= 0;
+#else
+  (void) sc, (void) fs, (void) path;
+  return false;
+#endif
+}
+
+// Return the cache entry for a path, filling it on a miss. The entry is
+// only valid until the next lookup, which may evict it.
+static struct mg_stat_entry *mg_stat_lookup(struct mg_mgr *mgr,
+                                            struct mg_fs *fs,
+                                            const char *path) {
+  struct mg_stat_cache *sc = mgr->stat_cache;
+  struct mg_stat_entry *e;
+  uint32_t hash = 2166136261U;  // FNV-1a
+  size_t n;
+  const char *p;
+  if (sc == NULL) return NULL;
+  for (p = path; *p != '\0'; p++) hash = (hash ^ (uint8_t) *p) * 16777619U;
+  n = (size_t) (p - path);
+  e = &sc->entries[hash % sc->len];
+  if (e->path != NULL && e->hash == hash && e->fs == fs &&
+      strcmp(e->path, path) == 0 &&
+      (e->expire == 0 || mg_millis() < e->expire)) {
+    return e;
+  }
+  free(e->path);
+  memset(e, 0, sizeof(*e));
+  if ((e->path = (char *) malloc(n + 1)) == NULL) return NULL;
+  memcpy(e->path, path, n + 1);
+  e->fs = fs;
+  e->hash = hash;
+  // Watch before stat(), so a change in between still invalidates
+  if (!mg_stat_cache_watch(sc, fs, path) && sc->ttl > 0) {
+    e->expire = mg_millis() + sc->ttl;
+  }
+  e->flags = fs->st(path, &e->size, &e->mtime);
+  return e;
+}
+
+static int mg_http_stat(struct mg_connection *c, struct mg_fs *fs,
+                        const char *path, size_t *size, time_t *mtime) {
+  struct mg_stat_entry *e = mg_stat_lookup(c->mgr, fs, path);
+  if (e == NULL) return fs->st(path, size, mtime);
+  if (size != NULL) *size = e->size;
+  if (mtime != NULL) *mtime = e->mtime;
+  return e->flags;
+}
+
+// In-memory copies of small static responses: the headers that only
+// depend on the file, followed by its body, sent with a single copy into
+// c->send. Entries are checked against the file size and mtime, so they
+// are as fresh as the stat cache. Least recently used ones are evicted
+// to stay within the byte budget.
+#define MG_ASSET_BUCKETS 64
+
+struct mg_asset {
+  struct mg_asset *hnext;  // Next in hash bucket
+  struct mg_asset *prev;   // LRU list, most recently used first
+  struct mg_asset *next;
+  struct mg_fs *fs;
+  char *path;
+  uint32_t hash;
+  size_t size;       // File size
+  time_t mtime;      // File modification time
+  struct mg_str ct;  // Content type, points into data
+  struct mg_str vary;  // Content-Encoding and Vary headers, into data
+  size_t len;        // Headers and body length
+  char data[1];      // "Content-Type: ...\r\n...\r\n" and body
+};
+
+struct mg_asset_cache {
+  struct mg_asset *buckets[MG_ASSET_BUCKETS];
+  struct mg_asset *head, *tail;  // LRU list
+  size_t budget;    // Maximum total bytes
+  size_t max_size;  // Largest file to keep
+  struct mg_asset_stats stats;
+};
+
+static uint32_t mg_asset_hash(const char *path) {
+  uint32_t hash = 2166136261U;  // FNV-1a
+  while (*path != '\0') hash = (hash ^ (uint8_t) *path++) * 16777619U;
+  return hash;
+}
+
+static void mg_asset_unlink(struct mg_asset_cache *ac, struct mg_asset *a) {
+  if (a->prev != NULL) a->prev->next = a->next;
+  if (a->next != NULL) a->next->prev = a->prev;
+  if (ac->head == a) ac->head = a->next;
+  if (ac->tail == a) ac->tail = a->prev;
+  a->prev = a->next = NULL;
+}
+
+static void mg_asset_push(struct mg_asset_cache *ac, struct mg_asset *a) {
+  a->next = ac->head;
+  if (ac->head != NULL) ac->head->prev = a;
+  ac->head = a;
+  if (ac->tail == NULL) ac->tail = a;
+}
+
+static void mg_asset_remove(struct mg_asset_cache *ac, struct mg_asset *a) {
+  struct mg_asset **p = &ac->buckets[a->hash % MG_ASSET_BUCKETS];
+  while (*p != a) p = &(*p)->hnext;
+  *p = a->hnext;
+  mg_asset_unlink(ac, a);
+  ac->stats.bytes -= a->len;
+  ac->stats.count--;
+  free(a->path);
+  free(a);
+}
+
+void mg_asset_cache_free(struct mg_mgr *mgr) {
+  struct mg_asset_cache *ac = mgr->asset_cache;
+  if (ac == NULL) return;
+  while (ac->head != NULL) mg_asset_remove(ac, ac->head);
+  free(ac);
+  mgr->asset_cache = NULL;
+}
+
+bool mg_asset_cache_init(struct mg_mgr *mgr, size_t budget, size_t max_size) {
+  struct mg_asset_cache *ac;
+  mg_asset_cache_free(mgr);
+  if (budget == 0) return true;
+  if ((ac = (struct mg_asset_cache *) calloc(1, sizeof(*ac))) == NULL) {
+    return false;
+  }
+  ac->budget = budget;
+  ac->max_size = max_size > budget ? budget : max_size;
+  mgr->asset_cache = ac;
+  return true;
+}
+
+void mg_asset_cache_stats(struct mg_mgr *mgr, struct mg_asset_stats *stats) {
+  if (mgr->asset_cache == NULL) {
+    memset(stats, 0, sizeof(*stats));
+  } else {
+    *stats = mgr->asset_cache->stats;
+  }
+}
+
+// Find an up-to-date response for a file. Counts a miss for files small
+// enough to be cached, so that the hit ratio reflects cacheable requests.
+static struct mg_asset *mg_asset_lookup(struct mg_mgr *mgr, struct mg_fs *fs,
+                                        const char *path, size_t size,
+                                        time_t mtime, struct mg_str ct,
+                                        const char *vary) {
+  struct mg_asset_cache *ac = mgr->asset_cache;
+  struct mg_asset *a;
+  uint32_t hash;
+  if (ac == NULL || size > ac->max_size) return NULL;
+  hash = mg_asset_hash(path);
+  for (a = ac->buckets[hash % MG_ASSET_BUCKETS]; a != NULL; a = a->hnext) {
+    if (a->hash == hash && a->fs == fs && strcmp(a->path, path) == 0) break;
+  }
+  if (a != NULL && (a->size != size || a->mtime != mtime ||
+                    mg_strcmp(a->ct, ct) != 0 ||
+                    mg_strcmp(a->vary, mg_str(vary)) != 0)) {
+    mg_asset_remove(ac, a);  // Stale, mg_asset_store() reloads it
+    a = NULL;
+  }
+  if (a == NULL) {
+    ac->stats.misses++;
+  } else {
+    ac->stats.hits++;
+    mg_asset_unlink(ac, a);
+    mg_asset_push(ac, a);
+  }
+  return a;
+}
+
+// Read a whole file, positioned at its start, into a new cache entry.
+// On failure the file is rewound, so it can still be streamed.
+static struct mg_asset *mg_asset_store(struct mg_mgr *mgr, struct mg_fd *fd,
+                                       const char *path, size_t size,
+                                       time_t mtime, struct mg_str ct,
+                                       const char *etag, const char *vary) {
+  struct mg_asset_cache *ac = mgr->asset_cache;
+  struct mg_asset *a;
+  char head[512], lm[40] = "";
+  size_t hlen, n, got = 0;
+  if (ac == NULL || size > ac->max_size) return NULL;
+  mg_http_date(lm, sizeof(lm), mtime);
+  hlen = mg_snprintf(head, sizeof(head),
+                     "Content-Type: %.*s\r\nEtag: %s\r\n"
+                     "Last-Modified: %s\r\nContent-Length: %llu\r\n%s\r\n",
+                     (int) ct.len, ct.ptr, etag, lm, (uint64_t) size, vary);
+  if (hlen >= sizeof(head) || hlen + size > ac->budget) return NULL;
+  if ((a = (struct mg_asset *) calloc(1, sizeof(*a) + hlen + size)) == NULL ||
+      (a->path = strdup(path)) == NULL) {
+    free(a);
+    return NULL;
+  }
+  memcpy(a->data, head, hlen);
+  while (got < size &&
+         (n = fd->fs->rd(fd->fd, a->data + hlen + got, size - got)) > 0) {
+    got += n;
+  }
+  if (got != size) {  // Changed under our feet
+    fd->fs->sk(fd->fd, 0);
+    free(a->path);
+    free(a);
+    return NULL;
+  }
+  a->fs = fd->fs;
+  a->hash = mg_asset_hash(path);
+  a->size = size;
+  a->mtime = mtime;
+  a->len = hlen + size;
+  a->ct = mg_str_n(a->data + 14, ct.len);  // Past "Content-Type: "
+  a->vary = mg_str_n(a->data + hlen - 2 - strlen(vary), strlen(vary));
+  while (ac->tail != NULL && ac->stats.bytes + a->len > ac->budget) {
+    mg_asset_remove(ac, ac->tail);
+    ac->stats.evictions++;
+  }
+  a->hnext = ac->buckets[a->hash % MG_ASSET_BUCKETS];
+  ac->buckets[a->hash % MG_ASSET_BUCKETS] = a;
+  mg_asset_push(ac, a);
+  ac->stats.bytes += a->len;
+  ac->stats.count++;
+  return a;
 }
 
 char *mg_http_etag(char *buf, size_t len, size_t size, time_t mtime);
@@ -1329,6 +1836,16 @@ char *mg_http_etag(char *buf, size_t len, size_t size, time_t mtime) {
   return buf;
 }
 
+// Each content coding of a file is a distinct representation, so it gets
+// its own entity tag, e.g. "1663000000.1234-br"
+static bool mg_http_variant_etag(char *buf, size_t len, size_t size,
+                                 time_t mtime, const char *coding) {
+  if (coding == NULL) return mg_http_etag(buf, len, size, mtime) != NULL;
+  mg_snprintf(buf, len, "\"%lld.%lld-%s\"", (int64_t) mtime, (int64_t) size,
+              coding);
+  return true;
+}
+
 static void static_cb(struct mg_connection *c, int ev, void *ev_data,
                       void *fn_data) {
   if (ev == MG_EV_WRITE || ev == MG_EV_POLL) {
@@ -1406,85 +1923,363 @@ static struct mg_str guess_content_type(struct mg_str path, const char *extra) {
   return mg_str("text/plain; charset=utf-8");
 }
 
-static int getrange(struct mg_str *s, int64_t *a, int64_t *b) {
-  size_t i, numparsed = 0;
-  // MG_INFO(("%.*s", (int) s->len, s->ptr));
-  for (i = 0; i + 6 < s->len; i++) {
-    if (memcmp(&s->ptr[i], "bytes=", 6) == 0) {
-      struct mg_str p = mg_str_n(s->ptr + i + 6, s->len - i - 6);
-      if (p.len > 0 && p.ptr[0] >= '0' && p.ptr[0] <= '9') numparsed++;
-      *a = mg_to64(p);
-      // MG_INFO(("PPP [%.*s] %d", (int) p.len, p.ptr, numparsed));
-      while (p.len && p.ptr[0] >= '0' && p.ptr[0] <= '9') p.ptr++, p.len--;
-      if (p.len && p.ptr[0] == '-') p.ptr++, p.len--;
-      *b = mg_to64(p);
-      if (p.len > 0 && p.ptr[0] >= '0' && p.ptr[0] <= '9') numparsed++;
-      // MG_INFO(("PPP [%.*s] %d", (int) p.len, p.ptr, numparsed));
-      break;
+// Built-in table results point to static strings and can be cached,
+// user-provided overrides cannot
+static struct mg_str mg_http_content_type(struct mg_connection *c,
+                                          struct mg_fs *fs, const char *path,
+                                          const char *extra) {
+  struct mg_stat_entry *e;
+  if (extra != NULL || (e = mg_stat_lookup(c->mgr, fs, path)) == NULL) {
+    return guess_content_type(mg_str(path), extra);
+  }
+  if (e->mime.ptr == NULL) e->mime = guess_content_type(mg_str(path), NULL);
+  return e->mime;
+}
+
+#ifndef MG_MAX_RANGES
+#define MG_MAX_RANGES 16
+#endif
+
+struct mg_range {
+  int64_t start, end;  // Inclusive byte positions
+};
+
+static bool mg_parse_pos(struct mg_str *s, int64_t *v) {
+  size_t n = 0;
+  *v = 0;
+  while (n < s->len && n < 18 && s->ptr[n] >= '0' && s->ptr[n] <= '9') {
+    *v = *v * 10 + (s->ptr[n++] - '0');
+  }
+  s->ptr += n, s->len -= n;
+  return n > 0;
+}
+
+// Parse "bytes=0-99,200-,-50" against the file size. Returns the number of
+// satisfiable ranges, or -1 if the header is to be ignored: malformed, not
+// in bytes, or with more than `max` ranges.
+static int mg_http_parse_ranges(struct mg_str *h, int64_t size,
+                                struct mg_range *r, int max) {
+  struct mg_str s = *h;
+  int n = 0;
+  while (s.len > 0 && s.ptr[0] == ' ') s.ptr++, s.len--;
+  if (s.len < 6 || mg_ncasecmp(s.ptr, "bytes=", 6) != 0) return -1;
+  s.ptr += 6, s.len -= 6;
+  while (s.len > 0) {
+    int64_t a = -1, b = -1;
+    while (s.len > 0 && (s.ptr[0] == ' ' || s.ptr[0] == ',')) s.ptr++, s.len--;
+    if (s.len == 0) break;
+    if (s.ptr[0] == '-') {  // Suffix range, the last b bytes
+      s.ptr++, s.len--;
+      if (!mg_parse_pos(&s, &b)) return -1;
+      if (b > 0 && size > 0) a = b > size ? 0 : size - b, b = size - 1;
+    } else {
+      if (!mg_parse_pos(&s, &a) || s.len == 0 || s.ptr[0] != '-') return -1;
+      s.ptr++, s.len--;
+      if (!mg_parse_pos(&s, &b)) {
+        b = size - 1;
+      } else if (b < a) {
+        return -1;
+      }
+      if (b >= size) b = size - 1;
+      if (a >= size) a = -1;  // Unsatisfiable, skip
+    }
+    while (s.len > 0 && s.ptr[0] == ' ') s.ptr++, s.len--;
+    if (s.len > 0 && s.ptr[0] != ',') return -1;
+    if (a < 0) continue;
+    if (n == max) return -1;
+    r[n].start = a, r[n].end = b, n++;
+  }
+  return n;
+}
+
+// A Range is only honoured if If-Range, when present, still matches: a
+// strong ETag, or the exact Last-Modified date
+static bool mg_http_if_range(struct mg_http_message *hm, const char *etag,
+                             time_t mtime) {
+  struct mg_str *ir = mg_http_get_header(hm, "If-Range");
+  if (ir == NULL) return true;
+  if (ir->len > 0 && ir->ptr[0] == '"') return mg_vcmp(ir, etag) == 0;
+  if (ir->len > 1 && ir->ptr[0] == 'W' && ir->ptr[1] == '/') return false;
+  return mg_http_parse_date(*ir) == mtime;
+}
+
+// State of a multipart/byteranges response
+struct mg_ranges {
+  struct mg_fd *fd;
+  int64_t size;                       // File size
+  int64_t left;                       // Bytes left in the current part
+  int n, next;                        // Number of ranges, next to send
+  struct mg_range r[MG_MAX_RANGES];   // Requested ranges
+  char boundary[20];                  // Part delimiter
+  char ct[128];                       // Content type of every part
+};
+
+static size_t mg_ranges_part_head(struct mg_ranges *rs, int i, char *buf,
+                                  size_t len) {
+  return mg_snprintf(buf, len,
+                     "\r\n--%s\r\nContent-Type: %s\r\n"
+                     "Content-Range: bytes %lld-%lld/%lld\r\n\r\n",
+                     rs->boundary, rs->ct, rs->r[i].start, rs->r[i].end,
+                     rs->size);
+}
+
+static void restore_ranges_cb(struct mg_connection *c) {
+  struct mg_ranges *rs = (struct mg_ranges *) c->pfn_data;
+  mg_fs_close(rs->fd);
+  free(rs);
+  c->pfn_data = NULL;
+  c->pfn = http_cb;
+  if (!c->is_closing && !c->is_draining) mg_http_resume(c);
+}
+
+// Like static_cb(), the parts are read straight into the send buffer. The
+// part headers are written in between, as their ranges start.
+static void static_ranges_cb(struct mg_connection *c, int ev, void *ev_data,
+                             void *fn_data) {
+  struct mg_ranges *rs = (struct mg_ranges *) fn_data;
+  if (ev == MG_EV_WRITE || ev == MG_EV_POLL) {
+    size_t n = 1, max = MG_IO_SIZE, space;
+    if (c->send.size < max) mg_iobuf_resize(&c->send, max);
+    while (n > 0 && c->send.len < c->send.size) {
+      if (rs->left == 0) {
+        char head[256];
+        if (rs->next == rs->n) {
+          mg_printf(c, "\r\n--%s--\r\n", rs->boundary);
+          restore_ranges_cb(c);
+          break;
+        }
+        mg_send(c, head, mg_ranges_part_head(rs, rs->next, head, sizeof(head)));
+        rs->fd->fs->sk(rs->fd->fd, (size_t) rs->r[rs->next].start);
+        rs->left = rs->r[rs->next].end - rs->r[rs->next].start + 1;
+        rs->next++;
+      }
+      space = c->send.size - c->send.len;
+      if ((int64_t) space > rs->left) space = (size_t) rs->left;
+      n = rs->fd->fs->rd(rs->fd->fd, c->send.buf + c->send.len, space);
+      c->send.len += n;
+      rs->left -= (int64_t) n;
+      if (n == 0) {
+        c->is_draining = 1;  // File shrank, the response cannot complete
+        restore_ranges_cb(c);
+      }
     }
+  } else if (ev == MG_EV_CLOSE) {
+    restore_ranges_cb(c);
   }
-  return (int) numparsed;
+  (void) ev_data;
+}
+
+// Send the head of a multipart/byteranges response and set up the parts
+static void mg_http_serve_ranges(struct mg_connection *c, struct mg_fd *fd,
+                                 struct mg_range *r, int n, int64_t size,
+                                 struct mg_str mime, const char *etag,
+                                 const char *lm, const char *vary,
+                                 const struct mg_http_serve_opts *opts,
+                                 bool is_head) {
+  struct mg_ranges *rs = (struct mg_ranges *) calloc(1, sizeof(*rs));
+  char head[256];
+  uint32_t rnd[2];
+  int64_t cl = 0;
+  int i;
+  if (rs == NULL) {
+    mg_fs_close(fd);
+    mg_http_reply(c, 500, "", "%s", "Out of memory\n");
+    return;
+  }
+  mg_random(rnd, sizeof(rnd));
+  mg_snprintf(rs->boundary, sizeof(rs->boundary), "%08lx%08lx",
+              (unsigned long) rnd[0], (unsigned long) rnd[1]);
+  mg_snprintf(rs->ct, sizeof(rs->ct), "%.*s", (int) mime.len, mime.ptr);
+  memcpy(rs->r, r, (size_t) n * sizeof(*r));
+  rs->n = n, rs->size = size, rs->fd = fd;
+  for (i = 0; i < n; i++) {
+    cl += (int64_t) mg_ranges_part_head(rs, i, head, sizeof(head));
+    cl += r[i].end - r[i].start + 1;
+  }
+  cl += (int64_t) strlen(rs->boundary) + 8;  // "\r\n--" boundary "--\r\n"
+  mg_http_write_status(c, 206, opts->extra_headers);
+  mg_printf(c,
+            "Content-Type: multipart/byteranges; boundary=%s\r\n"
+            "Etag: %s\r\n"
+            "Last-Modified: %s\r\n"
+            "Content-Length: %lld\r\n"
+            "%s%s\r\n",
+            rs->boundary, etag, lm, cl, vary,
+            opts->extra_headers ? opts->extra_headers : "");
+  if (is_head) {
+    c->is_draining = 1;
+    mg_fs_close(fd);
+    free(rs);
+  } else {
+    c->pfn = static_ranges_cb;
+    c->pfn_data = rs;
+    c->is_paused = 1;  // Until restore_ranges_cb()
+    c->is_full = 1;
+  }
+}
+
+// Check whether Accept-Encoding lists a coding without q=0
+static bool mg_http_accepts(struct mg_str *ae, const char *coding) {
+  size_t n = strlen(coding), i = 0;
+  while (ae != NULL && i < ae->len) {
+    size_t j = i, k;
+    while (j < ae->len && ae->ptr[j] != ',') j++;
+    while (i < j && ae->ptr[i] == ' ') i++;
+    if (j - i >= n && mg_ncasecmp(&ae->ptr[i], coding, n) == 0 &&
+        (i + n == j || ae->ptr[i + n] == ' ' || ae->ptr[i + n] == ';')) {
+      for (k = i + n; k < j && ae->ptr[k] != '='; k++) (void) 0;
+      if (k + 1 >= j || ae->ptr[k + 1] != '0') return true;
+      for (k += 2; k < j && (ae->ptr[k] == '.' || ae->ptr[k] == '0'); k++)
+        (void) 0;
+      return k < j && ae->ptr[k] >= '1' && ae->ptr[k] <= '9';
+    }
+    i = j + 1;
+  }
+  return false;
+}
+
+// Look for precompressed "<path>.br" and "<path>.gz" siblings. The first
+// one the client accepts is copied to buf, and its coding is returned.
+// *variants tells whether any sibling exists, i.e. the response varies.
+static const char *mg_http_precompressed(struct mg_connection *c,
+                                         struct mg_fs *fs,
+                                         struct mg_http_message *hm,
+                                         const char *path, char *buf,
+                                         size_t len, bool *variants) {
+  static const char *codings[][2] = {{"br", ".br"}, {"gzip", ".gz"}};
+  struct mg_str *ae = mg_http_get_header(hm, "Accept-Encoding");
+  const char *coding = NULL;
+  size_t i;
+  *variants = false;
+  for (i = 0; i < sizeof(codings) / sizeof(codings[0]); i++) {
+    char tmp[MG_PATH_MAX];
+    int flags;
+    if (mg_snprintf(tmp, sizeof(tmp), "%s%s", path, codings[i][1]) >=
+        sizeof(tmp))
+      continue;
+    flags = mg_http_stat(c, fs, tmp, NULL, NULL);
+    if (flags == 0 || (flags & MG_FS_DIR) != 0) continue;
+    *variants = true;
+    if (coding == NULL && mg_http_accepts(ae, codings[i][0])) {
+      mg_snprintf(buf, len, "%s", tmp);
+      coding = codings[i][0];
+    }
+  }
+  return coding;
 }
 
 void mg_http_serve_file(struct mg_connection *c, struct mg_http_message *hm,
                         const char *path,
                         const struct mg_http_serve_opts *opts) {
-  char etag[64];
+  char etag[64], encoded[MG_PATH_MAX], vary[100] = "", lm[40] = "";
   struct mg_fs *fs = opts->fs == NULL ? &mg_fs_posix : opts->fs;
-  struct mg_fd *fd = mg_fs_open(fs, path, MG_FS_READ);
+  bool variants = false;
+  const char *coding = mg_http_precompressed(c, fs, hm, path, encoded,
+                                             sizeof(encoded), &variants);
+  const char *file = coding == NULL ? path : encoded;
+  struct mg_fd *fd = NULL;
+  struct mg_asset *asset = NULL;
   size_t size = 0;
   time_t mtime = 0;
-  struct mg_str *inm = NULL;
-
-  if (fd == NULL || fs->st(path, &size, &mtime) == 0) {
-    MG_DEBUG(("404 [%s] %p", path, (void *) fd));
+  bool is_head = mg_vcasecmp(&hm->method, "HEAD") == 0;
+
+  if (coding != NULL) {
+    mg_snprintf(vary, sizeof(vary),
+                "Content-Encoding: %s\r\nVary: Accept-Encoding\r\n", coding);
+  } else if (variants) {
+    mg_snprintf(vary, sizeof(vary), "Vary: Accept-Encoding\r\n");
+  }
+  // The file is only opened when its body has to be read, validated and
+  // in-memory responses are served from metadata alone
+  if (mg_http_stat(c, fs, file, &size, &mtime) == 0) {
+    MG_DEBUG(("404 [%s]", path));
     mg_http_reply(c, 404, "", "%s", "Not found\n");
-    mg_fs_close(fd);
     // NOTE: mg_http_etag() call should go first!
-  } else if (mg_http_etag(etag, sizeof(etag), size, mtime) != NULL &&
-             (inm = mg_http_get_header(hm, "If-None-Match")) != NULL &&
-             mg_vcasecmp(inm, etag) == 0) {
-    mg_fs_close(fd);
-    mg_printf(c, "HTTP/1.1 304 Not Modified\r\nContent-Length: 0\r\n\r\n");
+  } else if (mg_http_variant_etag(etag, sizeof(etag), size, mtime, coding) &&
+             mg_http_is_fresh(hm, etag, mtime)) {
+    // Validators and caching headers are repeated, as a 200 would send them
+    mg_http_write_status(c, 304, opts->extra_headers);
+    mg_http_date(lm, sizeof(lm), mtime);
+    mg_printf(c,
+              "Etag: %s\r\n"
+              "Last-Modified: %s\r\n"
+              "%s%sContent-Length: 0\r\n\r\n",
+              etag, lm, vary, opts->extra_headers ? opts->extra_headers : "");
+  } else if (!is_head && mg_http_get_header(hm, "Range") == NULL &&
+             (asset = mg_asset_lookup(c->mgr, fs, file, size, mtime,
+                                      mg_http_content_type(c, fs, path,
+                                                           opts->mime_types),
+                                      vary)) != NULL) {
+    // Content type, ETag and coding are fixed by the file name and metadata
+    mg_http_write_status(c, 200, opts->extra_headers);
+    if (opts->extra_headers != NULL) {
+      mg_send(c, opts->extra_headers, strlen(opts->extra_headers));
+    }
+    mg_send(c, asset->data, asset->len);
+  } else if ((fd = mg_fs_open(fs, file, MG_FS_READ)) == NULL) {
+    MG_DEBUG(("404 [%s] %p", path, (void *) fd));
+    mg_http_reply(c, 404, "", "%s", "Not found\n");
   } else {
-    int n, status = 200;
+    int n = -1, status = 200;
     char range[100] = "";
-    int64_t r1 = 0, r2 = 0, cl = (int64_t) size;
-    struct mg_str mime = guess_content_type(mg_str(path), opts->mime_types);
+    int64_t cl = (int64_t) size;
+    struct mg_str mime = mg_http_content_type(c, fs, path, opts->mime_types);
+    struct mg_range ranges[MG_MAX_RANGES];
 
     // Handle Range header
     struct mg_str *rh = mg_http_get_header(hm, "Range");
-    if (rh != NULL && (n = getrange(rh, &r1, &r2)) > 0 && r1 >= 0 && r2 >= 0) {
-      // If range is specified like "400-", set second limit to content len
-      if (n == 1) r2 = cl - 1;
-      if (r1 > r2 || r2 >= cl) {
-        status = 416;
-        cl = 0;
-        mg_snprintf(range, sizeof(range), "Content-Range: bytes */%lld\r\n",
-                    (int64_t) size);
-      } else {
-        status = 206;
-        cl = r2 - r1 + 1;
-        mg_snprintf(range, sizeof(range),
-                    "Content-Range: bytes %lld-%lld/%lld\r\n", r1, r1 + cl - 1,
-                    (int64_t) size);
-        fs->sk(fd->fd, (size_t) r1);
+    if (rh != NULL && mg_http_if_range(hm, etag, mtime)) {
+      n = mg_http_parse_ranges(rh, (int64_t) size, ranges, MG_MAX_RANGES);
+    }
+    if (n == 0) {
+      status = 416;
+      cl = 0;
+      mg_snprintf(range, sizeof(range), "Content-Range: bytes */%lld\r\n",
+                  (int64_t) size);
+    } else if (n == 1) {
+      status = 206;
+      cl = ranges[0].end - ranges[0].start + 1;
+      mg_snprintf(range, sizeof(range),
+                  "Content-Range: bytes %lld-%lld/%lld\r\n", ranges[0].start,
+                  ranges[0].end, (int64_t) size);
+      fs->sk(fd->fd, (size_t) ranges[0].start);
+    } else if (n > 1) {
+      mg_http_date(lm, sizeof(lm), mtime);
+      mg_http_serve_ranges(c, fd, ranges, n, (int64_t) size, mime, etag, lm,
+                           vary, opts, is_head);
+      return;
+    }
+    if (status == 200 && !is_head &&
+        (asset = mg_asset_store(c->mgr, fd, file, size, mtime, mime, etag,
+                                vary)) != NULL) {
+      // Just loaded into the asset cache, reply from memory
+      mg_fs_close(fd);
+      mg_http_write_status(c, 200, opts->extra_headers);
+      if (opts->extra_headers != NULL) {
+        mg_send(c, opts->extra_headers, strlen(opts->extra_headers));
       }
+      mg_send(c, asset->data, asset->len);
+      return;
     }
+    mg_http_write_status(c, status, opts->extra_headers);
+    mg_http_date(lm, sizeof(lm), mtime);
     mg_printf(c,
-              "HTTP/1.1 %d %s\r\n"
               "Content-Type: %.*s\r\n"
               "Etag: %s\r\n"
+              "Last-Modified: %s\r\n"
               "Content-Length: %llu\r\n"
-              "%s%s\r\n",
-              status, mg_http_status_code_str(status), (int) mime.len, mime.ptr,
-              etag, cl, range, opts->extra_headers ? opts->extra_headers : "");
-    if (mg_vcasecmp(&hm->method, "HEAD") == 0) {
+              "%s%s%s\r\n",
+              (int) mime.len, mime.ptr, etag, lm, cl, range, vary,
+              opts->extra_headers ? opts->extra_headers : "");
+    if (is_head) {
       c->is_draining = 1;
       mg_fs_close(fd);
     } else {
       c->pfn = static_cb;
       c->pfn_data = fd;
+      // Pipelined requests wait for the body, restore_http_cb() resumes
+      c->is_paused = 1;
+      c->is_full = 1;
       *(size_t *) c->label = (size_t) cl;  // Track to-be-sent content length
     }
   }
@@ -1631,7 +2426,8 @@ static int uri_to_path2(struct mg_connection *c, struct mg_http_message *hm,
   n = strlen(path);
   MG_VERBOSE(("%lu %.*s -> %s", c->id, (int) hm->uri.len, hm->uri.ptr, path));
   while (n > 0 && path[n - 1] == '/') path[--n] = 0;  // Trim trailing slashes
-  flags = mg_vcmp(&hm->uri, "/") == 0 ? MG_FS_DIR : fs->st(path, NULL, NULL);
+  flags = mg_vcmp(&hm->uri, "/") == 0 ? MG_FS_DIR
+                                      : mg_http_stat(c, fs, path, NULL, NULL);
   if (flags == 0) {
     mg_http_reply(c, 404, "", "Not found\n");  // Does not exist, doh
   } else if ((flags & MG_FS_DIR) && hm->uri.len > 0 &&
@@ -1645,9 +2441,9 @@ static int uri_to_path2(struct mg_connection *c, struct mg_http_message *hm,
     flags = 0;
   } else if (flags & MG_FS_DIR) {
     if (((mg_snprintf(path + n, path_size - n, "/" MG_HTTP_INDEX) > 0 &&
-          (tmp = fs->st(path, NULL, NULL)) != 0) ||
+          (tmp = mg_http_stat(c, fs, path, NULL, NULL)) != 0) ||
          (mg_snprintf(path + n, path_size - n, "/index.shtml") > 0 &&
-          (tmp = fs->st(path, NULL, NULL)) != 0))) {
+          (tmp = mg_http_stat(c, fs, path, NULL, NULL)) != 0))) {
       flags = tmp;
     } else {
       path[n] = '\0';  // Remove appended index file name
@@ -1766,42 +2562,44 @@ static size_t get_chunk_length(const char *buf, size_t len, size_t *ll) {
   return 0;
 }
 
-// Walk through all chunks in the chunked body. For each chunk, fire
-// an MG_EV_HTTP_CHUNK event.
+// Walk through all complete chunks in the chunked body. For each chunk, fire
+// an MG_EV_HTTP_CHUNK event, then move its payload right after the payload
+// decoded so far, so the body is compacted in a single forward pass. The
+// number of decoded body bytes is kept in c->pfn_data between reads, thus
+// chunks decoded on earlier reads are neither walked nor reported again.
 static void walkchunks(struct mg_connection *c, struct mg_http_message *hm,
                        size_t reqlen) {
-  size_t off = 0, bl, ll;
-  while (off + reqlen < c->recv.len) {
-    char *buf = (char *) &c->recv.buf[reqlen];
-    size_t memo = c->recv.len;
-    size_t cl = get_chunk_length(&buf[off], memo - reqlen - off, &ll);
-    // MG_INFO(("len %zu off %zu cl %zu ll %zu", len, off, cl, ll));
-    if (cl == 0) break;
-    hm->chunk = mg_str_n(&buf[off + ll], cl < ll + 2 ? 0 : cl - ll - 2);
+  char *buf = (char *) &c->recv.buf[reqlen];
+  size_t len = c->recv.len - reqlen, dst = (size_t) c->pfn_data, src = dst;
+  size_t cl, ll, n;
+  bool done = false;
+  while (!done && src < len &&
+         (cl = get_chunk_length(&buf[src], len - src, &ll)) > 0) {
+    n = cl < ll + 2 ? 0 : cl - ll - 2;
+    hm->chunk = mg_str_n(&buf[src + ll], n);
     mg_call(c, MG_EV_HTTP_CHUNK, hm);
-    // Increase offset only if user has not deleted this chunk
-    if (memo == c->recv.len) off += cl;
-    if (cl <= 5) {
-      // Zero chunk - last one. Prepare body - cut off chunk lengths
-      off = bl = 0;
-      while (off + reqlen < c->recv.len) {
-        char *buf2 = (char *) &c->recv.buf[reqlen];
-        size_t memo2 = c->recv.len;
-        size_t cl2 = get_chunk_length(&buf2[off], memo2 - reqlen - off, &ll);
-        size_t n = cl2 < ll + 2 ? 0 : cl2 - ll - 2;
-        memmove(buf2 + bl, buf2 + off + ll, n);
-        bl += n;
-        off += cl2;
-        if (cl2 <= 5) break;
-      }
-      // MG_INFO(("BL->%d del %d off %d", (int) bl, (int) del, (int) off));
-      c->recv.len -= off - bl;
-      // Set message length to indicate we've received
-      // everything, to fire MG_EV_HTTP_MSG
-      hm->message.len = bl + reqlen;
-      hm->body.len = bl;
-      break;
+    // mg_http_delete_chunk() resets hm->chunk instead of moving memory
+    if (hm->chunk.ptr != NULL) {
+      if (dst != src + ll) memmove(&buf[dst], &buf[src + ll], n);
+      dst += n;
     }
+    src += cl;
+    done = n == 0;  // Zero chunk - last one
+  }
+  // Close the gap left by stripped chunk framing, once per read
+  if (src > dst) {
+    memmove(&buf[dst], &buf[src], len - src);
+    c->recv.len -= src - dst;
+  }
+  if (done) {
+    // Set message length to indicate we've received
+    // everything, to fire MG_EV_HTTP_MSG
+    c->pfn_data = NULL;
+    hm->message.len = dst + reqlen;
+    hm->body.len = dst;
+  } else {
+    c->pfn_data = (void *) dst;
+    hm->message.len = hm->body.len = (size_t) ~0;
   }
 }
 
@@ -1814,10 +2612,10 @@ static bool mg_is_chunked(struct mg_http_message *hm) {
 void mg_http_delete_chunk(struct mg_connection *c, struct mg_http_message *hm) {
   struct mg_str ch = hm->chunk;
   const char *end = (char *) &c->recv.buf[c->recv.len], *ce;
-  bool chunked = mg_is_chunked(hm);
-  if (chunked) {
-    ch.len += 4, ch.ptr -= 2;  // \r\n before and after the chunk
-    while (ch.ptr > hm->body.ptr && *ch.ptr != '\n') ch.ptr--, ch.len++;
+  if (mg_is_chunked(hm)) {
+    // walkchunks() compacts the body itself, just let it skip this chunk
+    hm->chunk = mg_str_n(NULL, 0);
+    return;
   }
   ce = &ch.ptr[ch.len];
   if (ce < end) memmove((void *) ch.ptr, ce, (size_t) (end - ce));
@@ -1860,7 +2658,9 @@ int mg_http_status(const struct mg_http_message *hm) {
 static void http_cb(struct mg_connection *c, int ev, void *evd, void *fnd) {
   if (ev == MG_EV_READ || ev == MG_EV_CLOSE) {
     struct mg_http_message hm;
-    while (c->recv.buf != NULL && c->recv.len > 0) {
+    // A paused connection keeps reading, but pipelined requests wait until
+    // the pending reply is sent, so that replies stay in order
+    while (c->recv.buf != NULL && c->recv.len > 0 && !c->is_paused) {
       int n = mg_http_parse((char *) c->recv.buf, c->recv.len, &hm);
       bool is_chunked = n > 0 && mg_is_chunked(&hm);
       if (ev == MG_EV_CLOSE) {
@@ -3594,6 +4394,10 @@ void mg_mgr_free(struct mg_mgr *mgr) {
   mgr->timers = NULL;  // Important. Next call to poll won't touch timers
   for (c = mgr->conns; c != NULL; c = c->next) c->is_closing = 1;
   mg_mgr_poll(mgr, 0);
+  free(mgr->http_server);
+  mgr->http_server = NULL;
+  mg_stat_cache_free(mgr);
+  mg_asset_cache_free(mgr);
 #if MG_ARCH == MG_ARCH_FREERTOS_TCP
   FreeRTOS_DeleteSocketSet(mgr->ss);
 #endif
@@ -4405,11 +5209,11 @@ static void mg_iotest(struct mg_mgr *mgr, int ms) {
 
   for (c = mgr->conns; c != NULL; c = c->next) {
     if (c->is_closing || c->is_resolving || FD(c) == INVALID_SOCKET) continue;
-    FD_SET(FD(c), &rset);
+    if (!c->is_full) FD_SET(FD(c), &rset);
     if (FD(c) > maxfd) maxfd = FD(c);
     if (c->is_connecting || (c->send.len > 0 && c->is_tls_hs == 0))
       FD_SET(FD(c), &wset);
-    if (mg_tls_pending(c) > 0) tv = tv_zero;
+    if (mg_tls_pending(c) > 0 || c->is_resuming) tv = tv_zero;
   }
 
   if ((rc = select((int) maxfd + 1, &rset, &wset, NULL, &tv)) < 0) {
@@ -4453,6 +5257,7 @@ void mg_mgr_poll(struct mg_mgr *mgr, int ms) {
   uint64_t now;
 
   mg_iotest(mgr, ms);
+  mg_stat_cache_poll(mgr);
   now = mg_millis();
   mg_timer_poll(&mgr->timers, now);
 
@@ -4472,7 +5277,7 @@ void mg_mgr_poll(struct mg_mgr *mgr, int ms) {
     } else if (c->is_tls_hs) {
       if ((c->is_readable || c->is_writable)) mg_tls_handshake(c);
     } else {
-      if (c->is_readable) read_conn(c);
+      if (c->is_readable && !c->is_full) read_conn(c);
       if (c->is_writable) write_conn(c);
     }
 
@@ -657,6 +657,15 @@ int sscanf(const char *, const char *, ...);
 #endif
 #endif
 
+// Invalidate the static file stat cache with inotify instead of a TTL
+#ifndef MG_ENABLE_INOTIFY
+#if MG_ARCH == MG_ARCH_UNIX && defined(__linux__) && MG_ENABLE_SOCKET
+#define MG_ENABLE_INOTIFY 1
+#else
+#define MG_ENABLE_INOTIFY 0
+#endif
+#endif
+
 #ifndef MG_SOCK_LISTEN_BACKLOG_SIZE
 #define MG_SOCK_LISTEN_BACKLOG_SIZE 3
 #endif
@@ -956,6 +965,11 @@ struct mg_mgr {
   struct mg_timer *timers;      // Active timers
   void *priv;                   // Used by the experimental stack
   size_t extraconnsize;         // Used by the experimental stack
+  time_t http_date_time;        // Second the cached Date header is for
+  char http_date[48];           // Cached "Date: ...\r\n" response header
+  char *http_server;            // Optional "Server: ...\r\n" response header
+  struct mg_stat_cache *stat_cache;  // Static file metadata, if enabled
+  struct mg_asset_cache *asset_cache;  // Static responses, if enabled
 #if MG_ARCH == MG_ARCH_FREERTOS_TCP
   SocketSet_t ss;  // NOTE(lsm): referenced from socket struct
 #endif
@@ -987,9 +1001,12 @@ struct mg_connection {
   unsigned is_websocket : 1;   // WebSocket connection
   unsigned is_hexdumping : 1;  // Hexdump in/out traffic
   unsigned is_draining : 1;    // Send remaining data, then close and free
+  unsigned is_full : 1;        // Stop reads, until cleared
   unsigned is_closing : 1;     // Close and free the connection immediately
   unsigned is_readable : 1;    // Connection is ready to read
   unsigned is_writable : 1;    // Connection is ready to write
+  unsigned is_paused : 1;      // HTTP: hold further requests, see mg_http_resume()
+  unsigned is_resuming : 1;    // HTTP: the owner resumes it at the next poll
 };
 
 void mg_mgr_poll(struct mg_mgr *, int ms);
@@ -1070,6 +1087,29 @@ void mg_http_serve_file(struct mg_connection *, struct mg_http_message *hm,
                         const char *path, const struct mg_http_serve_opts *);
 void mg_http_reply(struct mg_connection *, int status_code, const char *headers,
                    const char *body_fmt, ...);
+void mg_http_reply_buf(struct mg_connection *, int status_code,
+                       const char *headers, const void *body, size_t len);
+void mg_http_write_head(struct mg_connection *, int status_code,
+                        const char *headers);
+void mg_http_set_server(struct mg_mgr *, const char *name);
+void mg_http_resume(struct mg_connection *);
+size_t mg_http_date(char *buf, size_t len, time_t t);
+struct mg_str mg_http_date_header(struct mg_mgr *);
+bool mg_http_is_fresh(struct mg_http_message *, const char *etag, time_t mtime);
+bool mg_stat_cache_init(struct mg_mgr *, size_t entries, uint64_t ttl_ms);
+void mg_stat_cache_free(struct mg_mgr *);
+
+struct mg_asset_stats {
+  uint64_t hits;       // Requests served from memory
+  uint64_t misses;     // Cacheable requests that had to read the file
+  uint64_t evictions;  // Entries dropped to stay within the budget
+  size_t bytes;        // Memory used by cached responses
+  size_t count;        // Number of cached responses
+};
+
+bool mg_asset_cache_init(struct mg_mgr *, size_t budget, size_t max_size);
+void mg_asset_cache_free(struct mg_mgr *);
+void mg_asset_cache_stats(struct mg_mgr *, struct mg_asset_stats *);
 struct mg_str *mg_http_get_header(struct mg_http_message *, const char *name);
 int mg_http_get_var(const struct mg_str *, const char *name, char *, size_t);
 int mg_url_decode(const char *s, size_t n, char *to, size_t to_len, int form);
@@ -0,0 +1,97 @@
+#include <string.h>
+#include "object-pool.h"
+
+typedef struct mgObjPoolItem mgObjPoolItem;
+
+// Idle items are chained through their own memory
+struct mgObjPoolItem {
+    mgObjPoolItem *next;
+};
+
+struct mgObjPool {
+    JSRuntime *rt;
+    mgObjPoolItem *idle;
+    size_t idleLen;
+    size_t maxIdle;
+    size_t itemSize;
+    size_t refs;    // The owner and every item in use
+};
+
+mgObjPool *mgObjPoolNew(JSRuntime *rt, size_t itemSize, size_t maxIdle)
+{
+    mgObjPool *pool = js_malloc_rt(rt, sizeof(*pool));
+    if (pool == NULL) return NULL;
+    pool->rt = rt;
+    pool->idle = NULL;
+    pool->idleLen = 0;
+    pool->maxIdle = maxIdle;
+    pool->itemSize = itemSize < sizeof(mgObjPoolItem) ? sizeof(mgObjPoolItem) : itemSize;
+    pool->refs = 1;
+    return pool;
+}
+
+static void trimIdle(mgObjPool *pool, size_t maxIdle)
+{
+    while (pool->idleLen > maxIdle)
+    {
+        mgObjPoolItem *item = pool->idle;
+        pool->idle = item->next;
+        pool->idleLen--;
+        js_free_rt(pool->rt, item);
+    }
+}
+
+static void unref(mgObjPool *pool)
+{
+    if (--pool->refs > 0) return;
+    trimIdle(pool, 0);
+    js_free_rt(pool->rt, pool);
+}
+
+void mgObjPoolRelease(mgObjPool *pool)
+{
+    if (pool == NULL) return;
+    pool->maxIdle = 0;
+    trimIdle(pool, 0);
+    unref(pool);
+}
+
+void mgObjPoolSetMaxIdle(mgObjPool *pool, size_t maxIdle)
+{
+    pool->maxIdle = maxIdle;
+    trimIdle(pool, maxIdle);
+}
+
+size_t mgObjPoolGetMaxIdle(mgObjPool *pool)
+{
+    return pool->maxIdle;
+}
+
+void *mgObjPoolGet(mgObjPool *pool)
+{
+    mgObjPoolItem *item = pool->idle;
+    if (item != NULL)
+    {
+        pool->idle = item->next;
+        pool->idleLen--;
+    }
+    else if ((item = js_malloc_rt(pool->rt, pool->itemSize)) == NULL)
+        return NULL;
+    memset(item, 0, pool->itemSize);
+    pool->refs++;
+    return item;
+}
+
+void mgObjPoolPut(mgObjPool *pool, void *item)
+{
+    if (pool->idleLen < pool->maxIdle)
+    {
+        mgObjPoolItem *idle = item;
+        idle->next = pool->idle;
+        pool->idle = idle;
+        pool->idleLen++;
+    }
+    else
+        js_free_rt(pool->rt, item);
+    unref(pool);
+}
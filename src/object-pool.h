@@ -0,0 +1,23 @@
+#ifndef QJS_OBJECT_POOL_H
+#define QJS_OBJECT_POOL_H
+
+#include "js-utils.h"
+
+// Recycles the fixed size native state of the objects a manager creates
+// for every event, so that steady traffic does not go through the
+// allocator. Every item taken holds a reference: the pool outlives its
+// manager until the last object using it is finalized.
+typedef struct mgObjPool mgObjPool;
+
+mgObjPool *mgObjPoolNew(JSRuntime *rt, size_t itemSize, size_t maxIdle);
+// Drops the owner's reference, idle items are freed right away
+void mgObjPoolRelease(mgObjPool *pool);
+// Idle items kept for reuse, 0 disables pooling
+void mgObjPoolSetMaxIdle(mgObjPool *pool, size_t maxIdle);
+size_t mgObjPoolGetMaxIdle(mgObjPool *pool);
+
+// Returns a zeroed item, or NULL when out of memory
+void *mgObjPoolGet(mgObjPool *pool);
+void mgObjPoolPut(mgObjPool *pool, void *item);
+
+#endif
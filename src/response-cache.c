@@ -0,0 +1,356 @@
+#include "response-cache.h"
+
+#define MG_RESP_CACHE_BUCKETS 1024
+// Longer method, host, URI and query strings are not worth caching
+#define MG_RESP_CACHE_MAX_KEY 2048
+
+typedef struct mgRespCacheEntry mgRespCacheEntry;
+
+struct mgRespCacheEntry {
+    mgRespCacheEntry *chain;        // Next entry of the hash bucket
+    mgRespCacheEntry *prev, *next;  // LRU list, most recently used first
+    uint32_t hash;                  // Of key
+    uint64_t ttl;
+    uint64_t expires;               // mg_millis() deadlines
+    uint64_t staleUntil;
+    uint64_t revalidating;          // When a request was let through to refresh it
+    uint64_t stored;                // For the Age header
+    const char *key, *varyNames, *varyValues;
+    const char *data;               // The serialized response, without Date and Server
+    size_t statusLen;               // Of the status line in data
+    size_t len;
+    size_t size;                    // Counted against the budget
+    char mem[1];                    // key, varyNames, varyValues, data
+};
+
+struct mgRespCache {
+    mgRespCacheEntry *buckets[MG_RESP_CACHE_BUCKETS];
+    mgRespCacheEntry *head, *tail;
+    size_t budget;
+    mgRespCacheStats stats;
+};
+
+static uint32_t hashKey(const char *key)
+{
+    uint32_t hash = 2166136261U; // FNV-1a
+    while (*key != '\0') hash = (hash ^ (uint8_t) *key++) * 16777619U;
+    return hash;
+}
+
+// Virtual hosts sharing a listener get separate entries
+static size_t makeKey(struct mg_http_message *hm, char *buf, size_t size)
+{
+    struct mg_str *host = mg_http_get_header(hm, "Host");
+    return mg_snprintf(buf, size, "%.*s %.*s %.*s?%.*s",
+        (int) hm->method.len, hm->method.ptr,
+        host == NULL ? 0 : (int) host->len, host == NULL ? "" : host->ptr,
+        (int) hm->uri.len, hm->uri.ptr,
+        (int) hm->query.len, hm->query.ptr);
+}
+
+// Compares the request headers named in names with the values an entry
+// was stored for
+static bool varyMatches(struct mg_http_message *hm, const char *names, const char *values)
+{
+    char name[64];
+    while (*names != '\0')
+    {
+        const char *end = strchr(names, ','), *eol = strchr(values, '\n');
+        size_t n = end == NULL ? strlen(names) : (size_t) (end - names);
+        size_t vlen = eol == NULL ? strlen(values) : (size_t) (eol - values);
+        struct mg_str *v;
+        mg_snprintf(name, sizeof(name), "%.*s", (int) n, names);
+        v = mg_http_get_header(hm, name);
+        if (v == NULL ? vlen != 0 : v->len != vlen || memcmp(v->ptr, values, vlen) != 0)
+            return false;
+        names += n + (end != NULL);
+        values += vlen + (eol != NULL);
+    }
+    return true;
+}
+
+static void unlinkLru(mgRespCache *rc, mgRespCacheEntry *e)
+{
+    if (e->prev != NULL) e->prev->next = e->next;
+    if (e->next != NULL) e->next->prev = e->prev;
+    if (rc->head == e) rc->head = e->next;
+    if (rc->tail == e) rc->tail = e->prev;
+    e->prev = e->next = NULL;
+}
+
+static void pushLru(mgRespCache *rc, mgRespCacheEntry *e)
+{
+    e->next = rc->head;
+    if (rc->head != NULL) rc->head->prev = e;
+    rc->head = e;
+    if (rc->tail == NULL) rc->tail = e;
+}
+
+static void removeEntry(mgRespCache *rc, mgRespCacheEntry *e)
+{
+    mgRespCacheEntry **p = &rc->buckets[e->hash % MG_RESP_CACHE_BUCKETS];
+    while (*p != e) p = &(*p)->chain;
+    *p = e->chain;
+    unlinkLru(rc, e);
+    rc->stats.bytes -= e->size;
+    rc->stats.count--;
+    free(e);
+}
+
+mgRespCache *mgRespCacheNew(size_t budget)
+{
+    mgRespCache *rc = calloc(1, sizeof(*rc));
+    if (rc != NULL) rc->budget = budget;
+    return rc;
+}
+
+void mgRespCacheFree(mgRespCache *rc)
+{
+    mgRespCacheEntry *e, *next;
+    if (rc == NULL) return;
+    for (e = rc->head; e != NULL; e = next)
+    {
+        next = e->next;
+        free(e);
+    }
+    free(rc);
+}
+
+void mgRespCacheGetStats(mgRespCache *rc, mgRespCacheStats *stats)
+{
+    if (rc == NULL)
+        memset(stats, 0, sizeof(*stats));
+    else
+        *stats = rc->stats;
+}
+
+static mgRespCacheEntry *findEntry(mgRespCache *rc, struct mg_http_message *hm)
+{
+    char key[MG_RESP_CACHE_MAX_KEY];
+    mgRespCacheEntry *e;
+    uint32_t hash;
+    if (mg_vcasecmp(&hm->method, "GET") != 0 || makeKey(hm, key, sizeof(key)) >= sizeof(key))
+        return NULL;
+    hash = hashKey(key);
+    for (e = rc->buckets[hash % MG_RESP_CACHE_BUCKETS]; e != NULL; e = e->chain)
+        if (e->hash == hash && strcmp(e->key, key) == 0 &&
+                varyMatches(hm, e->varyNames, e->varyValues)) break;
+    return e;
+}
+
+bool mgRespCacheHas(mgRespCache *rc, struct mg_http_message *hm)
+{
+    mgRespCacheEntry *e = findEntry(rc, hm);
+    uint64_t now = mg_millis();
+    if (e == NULL || now >= e->staleUntil) return false;
+    return now < e->expires || (e->revalidating != 0 && now - e->revalidating < e->ttl);
+}
+
+// The status line, then Date, Server and Age as of now, then the stored
+// headers and body
+static void sendEntry(struct mg_connection *c, mgRespCacheEntry *e, uint64_t now)
+{
+    struct mg_str date = mg_http_date_header(c->mgr);
+    char age[40];
+    size_t n = mg_snprintf(age, sizeof(age), "Age: %lu\r\n",
+        (unsigned long) ((now - e->stored) / 1000));
+    size_t need = c->send.len + e->len + date.len + n +
+        (c->mgr->http_server == NULL ? 0 : strlen(c->mgr->http_server));
+    if (c->send.size < need) mg_iobuf_resize(&c->send, need);
+    mg_send(c, e->data, e->statusLen);
+    if (date.len > 0) mg_send(c, date.ptr, date.len);
+    if (c->mgr->http_server != NULL)
+        mg_send(c, c->mgr->http_server, strlen(c->mgr->http_server));
+    mg_send(c, age, n);
+    mg_send(c, e->data + e->statusLen, e->len - e->statusLen);
+}
+
+bool mgRespCacheServe(mgRespCache *rc, struct mg_connection *c, struct mg_http_message *hm)
+{
+    mgRespCacheEntry *e = findEntry(rc, hm);
+    uint64_t now = mg_millis();
+    if (e != NULL && now >= e->staleUntil)
+    {
+        removeEntry(rc, e);
+        e = NULL;
+    }
+    // The first request past expiry refreshes the entry, the ones coming
+    // meanwhile get the stale copy. If that request does not store a new
+    // response, another one is let through after ttl.
+    if (e != NULL && now >= e->expires &&
+            (e->revalidating == 0 || now - e->revalidating >= e->ttl))
+    {
+        e->revalidating = now;
+        e = NULL;
+    }
+    if (e == NULL)
+    {
+        rc->stats.misses++;
+        return false;
+    }
+    if (now >= e->expires)
+        rc->stats.staleHits++;
+    else
+        rc->stats.hits++;
+    sendEntry(c, e, now);
+    unlinkLru(rc, e);
+    pushLru(rc, e);
+    return true;
+}
+
+mgRespCachePolicy *mgRespCachePolicyNew(struct mg_http_message *hm,
+    uint64_t ttl, uint64_t swr, const char *varyNames)
+{
+    char key[MG_RESP_CACHE_MAX_KEY], name[64];
+    struct mg_iobuf names = { NULL, 0, 0 }, values = { NULL, 0, 0 };
+    const char *p = varyNames == NULL ? "" : varyNames;
+    mgRespCachePolicy *res = NULL;
+    size_t keyLen, count = 0;
+    if (mg_vcasecmp(&hm->method, "GET") != 0 ||
+            (keyLen = makeKey(hm, key, sizeof(key))) >= sizeof(key))
+        return NULL;
+    while (*p != '\0')
+    {
+        const char *start, *end;
+        struct mg_str *v;
+        while (*p == ' ' || *p == ',') p++;
+        for (start = p; *p != '\0' && *p != ','; p++);
+        for (end = p; end > start && end[-1] == ' '; end--);
+        if (end == start || end - start >= (int) sizeof(name)) continue;
+        mg_snprintf(name, sizeof(name), "%.*s", (int) (end - start), start);
+        v = mg_http_get_header(hm, name);
+        if (count++ > 0)
+        {
+            mg_iobuf_add(&names, names.len, ",", 1, 64);
+            mg_iobuf_add(&values, values.len, "\n", 1, 64);
+        }
+        mg_iobuf_add(&names, names.len, name, strlen(name), 64);
+        if (v != NULL) mg_iobuf_add(&values, values.len, v->ptr, v->len, 64);
+    }
+    res = calloc(1, sizeof(*res) + keyLen + names.len + values.len + 3);
+    if (res != NULL)
+    {
+        res->ttl = ttl;
+        res->swr = swr;
+        res->key = (char *) (res + 1);
+        res->varyNames = res->key + keyLen + 1;
+        res->varyValues = res->varyNames + names.len + 1;
+        memcpy(res->key, key, keyLen);
+        if (names.len > 0) memcpy(res->varyNames, names.buf, names.len);
+        if (values.len > 0) memcpy(res->varyValues, values.buf, values.len);
+    }
+    mg_iobuf_free(&names);
+    mg_iobuf_free(&values);
+    return res;
+}
+
+void mgRespCachePolicyFree(mgRespCachePolicy *p)
+{
+    free(p);
+}
+
+// Statuses cacheable by default, RFC 9111 section 4.2.2
+static bool cacheableStatus(const char *resp, size_t len)
+{
+    int status = 0;
+    if (len < 12 || memcmp(resp, "HTTP/1.", 7) != 0) return false;
+    for (size_t i = 9; i < 12; i++)
+    {
+        if (resp[i] < '0' || resp[i] > '9') return false;
+        status = status * 10 + resp[i] - '0';
+    }
+    return status == 200 || status == 203 || status == 204 || status == 300 ||
+        status == 301 || status == 404 || status == 405 || status == 410 ||
+        status == 414 || status == 501;
+}
+
+static bool setsCookie(const char *resp, size_t len)
+{
+    static const char name[] = "\nSet-Cookie:";
+    size_t n = sizeof(name) - 1;
+    for (size_t i = 0; i + n <= len; i++)
+    {
+        if (resp[i] != '\n') continue;
+        if (i + 2 < len && resp[i + 1] == '\r' && resp[i + 2] == '\n') break; // End of head
+        if (mg_ncasecmp(resp + i, name, n) == 0) return true;
+    }
+    return false;
+}
+
+static bool isHeader(const char *line, size_t len, const char *name)
+{
+    size_t n = strlen(name);
+    return len > n && line[n] == ':' && mg_ncasecmp(line, name, n) == 0;
+}
+
+// Copies resp without its Date, Server and Age headers, which are added
+// fresh on every hit. Sets *statusLen to the length of the status line.
+static size_t copyResponse(char *dst, const char *resp, size_t len, size_t *statusLen)
+{
+    size_t i = 0, out = 0;
+    bool head = true;
+    *statusLen = 0;
+    while (i < len && head)
+    {
+        const char *eol = memchr(resp + i, '\n', len - i);
+        size_t n = eol == NULL ? len - i : (size_t) (eol - resp - i) + 1;
+        if (n <= 2) head = false; // The empty line ending the head
+        if (i == 0 || !head || !(isHeader(resp + i, n, "Date") ||
+                isHeader(resp + i, n, "Server") || isHeader(resp + i, n, "Age")))
+        {
+            memcpy(dst + out, resp + i, n);
+            out += n;
+        }
+        if (i == 0) *statusLen = n;
+        i += n;
+    }
+    memcpy(dst + out, resp + i, len - i);
+    return out + len - i;
+}
+
+void mgRespCacheStore(mgRespCache *rc, const mgRespCachePolicy *p, const void *resp, size_t len)
+{
+    size_t keyLen = strlen(p->key), namesLen = strlen(p->varyNames);
+    size_t valuesLen = strlen(p->varyValues);
+    size_t size = sizeof(mgRespCacheEntry) + keyLen + namesLen + valuesLen + 3 + len;
+    uint32_t hash = hashKey(p->key);
+    uint64_t now = mg_millis();
+    mgRespCacheEntry *e;
+    char *mem;
+    if (size > rc->budget || !cacheableStatus(resp, len) || setsCookie(resp, len))
+        return;
+    for (e = rc->buckets[hash % MG_RESP_CACHE_BUCKETS]; e != NULL; e = e->chain)
+    {
+        if (e->hash == hash && strcmp(e->key, p->key) == 0 &&
+                strcmp(e->varyNames, p->varyNames) == 0 &&
+                strcmp(e->varyValues, p->varyValues) == 0)
+        {
+            removeEntry(rc, e);
+            break;
+        }
+    }
+    while (rc->tail != NULL && rc->stats.bytes + size > rc->budget)
+    {
+        removeEntry(rc, rc->tail);
+        rc->stats.evictions++;
+    }
+    if ((e = calloc(1, size)) == NULL) return;
+    mem = e->mem;
+    e->key = memcpy(mem, p->key, keyLen + 1);
+    e->varyNames = memcpy(mem += keyLen + 1, p->varyNames, namesLen + 1);
+    e->varyValues = memcpy(mem += namesLen + 1, p->varyValues, valuesLen + 1);
+    e->data = mem + valuesLen + 1;
+    e->len = copyResponse(mem + valuesLen + 1, resp, len, &e->statusLen);
+    e->stored = now;
+    e->size = size;
+    e->hash = hash;
+    e->ttl = p->ttl;
+    e->expires = now + p->ttl;
+    e->staleUntil = e->expires + p->swr;
+    e->chain = rc->buckets[hash % MG_RESP_CACHE_BUCKETS];
+    rc->buckets[hash % MG_RESP_CACHE_BUCKETS] = e;
+    pushLru(rc, e);
+    rc->stats.bytes += size;
+    rc->stats.count++;
+    rc->stats.stores++;
+}
@@ -0,0 +1,55 @@
+#ifndef QJS_RESPONSE_CACHE_H
+#define QJS_RESPONSE_CACHE_H
+
+#include "mongoose.h"
+
+// Serialized GET responses, replayed without running the JS handler.
+// Entries are keyed by method, Host, URI and query, plus the request
+// headers named by the handler's Vary list. Date, Server and Age are
+// written fresh on every hit.
+typedef struct mgRespCache mgRespCache;
+
+// What a handler asked for, computed while its request is still around:
+// the reply may only be stored once the request buffer is gone
+typedef struct {
+    uint64_t ttl;       // Fresh for ttl milliseconds
+    uint64_t swr;       // Then served stale while one request revalidates
+    char *key;          // "GET host /uri?query"
+    char *varyNames;    // Header names separated by ","
+    char *varyValues;   // Their values in the request, separated by "\n"
+} mgRespCachePolicy;
+
+typedef struct {
+    uint64_t hits;
+    uint64_t staleHits;
+    uint64_t misses;
+    uint64_t stores;
+    uint64_t evictions;
+    size_t bytes;
+    size_t count;
+} mgRespCacheStats;
+
+mgRespCache *mgRespCacheNew(size_t budget);
+void mgRespCacheFree(mgRespCache *rc);
+void mgRespCacheGetStats(mgRespCache *rc, mgRespCacheStats *stats);
+
+// Sends the cached response of a GET request. Returns false when the
+// request has to go to its handler: nothing cached, expired, or stale with
+// no revalidation running yet.
+bool mgRespCacheServe(mgRespCache *rc, struct mg_connection *c, struct mg_http_message *hm);
+
+// Whether mgRespCacheServe() would answer the request now. Nothing is
+// counted and no revalidation starts.
+bool mgRespCacheHas(mgRespCache *rc, struct mg_http_message *hm);
+
+// Returns NULL when the request cannot be cached, e.g. it is not a GET
+mgRespCachePolicy *mgRespCachePolicyNew(struct mg_http_message *hm,
+    uint64_t ttl, uint64_t swr, const char *varyNames);
+void mgRespCachePolicyFree(mgRespCachePolicy *p);
+
+// Stores a complete serialized response, status line included. Only
+// statuses that are cacheable by default are kept, and never responses
+// setting cookies.
+void mgRespCacheStore(mgRespCache *rc, const mgRespCachePolicy *p, const void *resp, size_t len);
+
+#endif
@@ -0,0 +1,289 @@
+#include "route-tree.h"
+
+typedef struct mgRouteNode mgRouteNode;
+
+// A route ending at a node. last is the kind of its last segment when that
+// one is repeated or a catch-all, and MG_ROUTE_SEG_STATIC otherwise.
+typedef struct {
+    uint32_t order;
+    mgRouteSegKind last;
+    void *data;
+} mgRouteEnd;
+
+struct mgRouteNode {
+    char *text;                 // Lowercase static segment
+    size_t len;
+    mgRouteNode **statics;      // Sorted by text
+    size_t numStatics;
+    mgRouteNode *param;
+    mgRouteNode *optional;
+    mgRouteEnd *ends;
+    size_t numEnds;
+};
+
+typedef struct {
+    char *method;
+    mgRouteNode *root;
+} mgRouteRoot;
+
+struct mgRouteTree {
+    mgRouteRoot *roots;
+    size_t numRoots;
+};
+
+typedef struct {
+    const char *path;
+    size_t len;
+    uint32_t from;
+    bool found;
+    mgRouteMatch *best;
+    size_t depth;               // Parameters captured so far
+    struct mg_str caps[MG_ROUTE_MAX_PARAMS];
+} mgRouteSearch;
+
+static void freeNode(mgRouteNode *n)
+{
+    if (n == NULL) return;
+    for (size_t i = 0; i < n->numStatics; i++) freeNode(n->statics[i]);
+    freeNode(n->param);
+    freeNode(n->optional);
+    free(n->statics);
+    free(n->ends);
+    free(n->text);
+    free(n);
+}
+
+mgRouteTree *mgRouteTreeNew(void)
+{
+    return calloc(1, sizeof(mgRouteTree));
+}
+
+void mgRouteTreeFree(mgRouteTree *t)
+{
+    if (t == NULL) return;
+    for (size_t i = 0; i < t->numRoots; i++)
+    {
+        free(t->roots[i].method);
+        freeNode(t->roots[i].root);
+    }
+    free(t->roots);
+    free(t);
+}
+
+// Orders a path segment, compared case-insensitively, and a node segment
+static int compareSeg(const char *seg, size_t len, const mgRouteNode *n)
+{
+    for (size_t i = 0; i < len && i < n->len; i++)
+    {
+        int a = tolower((unsigned char) seg[i]), b = (unsigned char) n->text[i];
+        if (a != b) return a - b;
+    }
+    return len < n->len ? -1 : len > n->len;
+}
+
+// Binary search, *pos is where the segment would be inserted
+static mgRouteNode *findStatic(const mgRouteNode *n, const char *seg, size_t len, size_t *pos)
+{
+    size_t lo = 0, hi = n->numStatics;
+    while (lo < hi)
+    {
+        size_t mid = (lo + hi) / 2;
+        int cmp = compareSeg(seg, len, n->statics[mid]);
+        if (cmp == 0)
+        {
+            if (pos != NULL) *pos = mid;
+            return n->statics[mid];
+        }
+        if (cmp < 0) hi = mid; else lo = mid + 1;
+    }
+    if (pos != NULL) *pos = lo;
+    return NULL;
+}
+
+static mgRouteNode *addStatic(mgRouteNode *n, const char *seg, size_t len)
+{
+    mgRouteNode *child, **statics;
+    size_t pos;
+    if ((child = findStatic(n, seg, len, &pos)) != NULL) return child;
+    statics = realloc(n->statics, (n->numStatics + 1) * sizeof(*statics));
+    if (statics == NULL) return NULL;
+    n->statics = statics;
+    if ((child = calloc(1, sizeof(*child))) == NULL ||
+            (child->text = malloc(len + 1)) == NULL)
+    {
+        free(child);
+        return NULL;
+    }
+    for (size_t i = 0; i < len; i++) child->text[i] = (char) tolower((unsigned char) seg[i]);
+    child->text[len] = '\0';
+    child->len = len;
+    memmove(&statics[pos + 1], &statics[pos], (n->numStatics - pos) * sizeof(*statics));
+    statics[pos] = child;
+    n->numStatics++;
+    return child;
+}
+
+static mgRouteNode *addChild(mgRouteNode *n, const mgRouteSeg *seg)
+{
+    mgRouteNode **child;
+    if (seg->kind == MG_ROUTE_SEG_STATIC) return addStatic(n, seg->text, seg->len);
+    child = seg->kind == MG_ROUTE_SEG_PARAM ? &n->param : &n->optional;
+    if (*child == NULL) *child = calloc(1, sizeof(**child));
+    return *child;
+}
+
+static mgRouteNode *getRoot(mgRouteTree *t, const char *method)
+{
+    mgRouteRoot *roots;
+    for (size_t i = 0; i < t->numRoots; i++)
+        if (strcmp(t->roots[i].method, method) == 0) return t->roots[i].root;
+    roots = realloc(t->roots, (t->numRoots + 1) * sizeof(*roots));
+    if (roots == NULL) return NULL;
+    t->roots = roots;
+    roots += t->numRoots;
+    roots->root = calloc(1, sizeof(mgRouteNode));
+    roots->method = strdup(method);
+    if (roots->root == NULL || roots->method == NULL)
+    {
+        free(roots->root);
+        free(roots->method);
+        return NULL;
+    }
+    t->numRoots++;
+    return roots->root;
+}
+
+int mgRouteTreeAdd(mgRouteTree *t, const char *method,
+    const mgRouteSeg *segs, size_t n, uint32_t order, void *data)
+{
+    mgRouteSegKind last = MG_ROUTE_SEG_STATIC;
+    mgRouteNode *node;
+    mgRouteEnd *ends;
+    size_t numParams = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        if (segs[i].kind != MG_ROUTE_SEG_STATIC) numParams++;
+        if (segs[i].kind >= MG_ROUTE_SEG_ONE_OR_MORE && i + 1 < n) return -1;
+    }
+    if (numParams > MG_ROUTE_MAX_PARAMS || (node = getRoot(t, method)) == NULL)
+        return -1;
+    for (size_t i = 0; i < n; i++)
+    {
+        if (segs[i].kind >= MG_ROUTE_SEG_ONE_OR_MORE)
+            last = segs[i].kind;
+        else if ((node = addChild(node, &segs[i])) == NULL)
+            return -1;
+    }
+    ends = realloc(node->ends, (node->numEnds + 1) * sizeof(*ends));
+    if (ends == NULL) return -1;
+    ends[node->numEnds].order = order;
+    ends[node->numEnds].last = last;
+    ends[node->numEnds].data = data;
+    node->ends = ends;
+    node->numEnds++;
+    return 0;
+}
+
+static void consider(mgRouteSearch *s, const mgRouteEnd *e, const struct mg_str *rest)
+{
+    if (e->order < s->from || (s->found && e->order >= s->best->order)) return;
+    s->found = true;
+    s->best->data = e->data;
+    s->best->order = e->order;
+    s->best->numParams = s->depth;
+    memcpy(s->best->params, s->caps, s->depth * sizeof(s->caps[0]));
+    if (rest != NULL) s->best->params[s->best->numParams++] = *rest;
+}
+
+// The segments after pos, for a repeated parameter. Like path-to-regexp,
+// they must not be empty and one trailing slash is left out.
+static bool restSegments(const mgRouteSearch *s, size_t pos, struct mg_str *rest)
+{
+    size_t start = pos + 1, stop = s->len;
+    if (start >= stop) return false;
+    if (stop > start && s->path[stop - 1] == '/') stop--;
+    if (start == stop || s->path[start] == '/' || s->path[stop - 1] == '/') return false;
+    for (size_t i = start + 1; i < stop; i++)
+        if (s->path[i] == '/' && s->path[i - 1] == '/') return false;
+    *rest = mg_str_n(s->path + start, stop - start);
+    return true;
+}
+
+static void considerEnds(mgRouteSearch *s, const mgRouteNode *node, size_t pos)
+{
+    // A single trailing slash is optional
+    bool atEnd = pos == s->len || (pos + 1 == s->len && s->path[pos] == '/');
+    struct mg_str rest, none = mg_str_n(NULL, 0);
+    for (size_t i = 0; i < node->numEnds; i++)
+    {
+        const mgRouteEnd *e = &node->ends[i];
+        switch (e->last)
+        {
+        case MG_ROUTE_SEG_CATCH_ALL:
+            rest = mg_str_n(s->path + pos + 1, s->len - pos - 1);
+            if (pos < s->len) consider(s, e, &rest);
+            break;
+        case MG_ROUTE_SEG_ONE_OR_MORE:
+        case MG_ROUTE_SEG_ZERO_OR_MORE:
+            if (restSegments(s, pos, &rest))
+                consider(s, e, &rest);
+            else if (e->last == MG_ROUTE_SEG_ZERO_OR_MORE && atEnd)
+                consider(s, e, &none);
+            break;
+        default:
+            if (atEnd) consider(s, e, NULL);
+            break;
+        }
+    }
+}
+
+// pos is at the slash before the next segment, or at the end of the path.
+// Branches consuming a segment come first, so that among the ways a route
+// matches, optional parameters get a value when they can, as with a regexp.
+static void search(mgRouteSearch *s, const mgRouteNode *node, size_t pos)
+{
+    considerEnds(s, node, pos);
+    if (pos < s->len)
+    {
+        const char *seg = s->path + pos + 1;
+        size_t end = pos + 1, len;
+        const mgRouteNode *child;
+        while (end < s->len && s->path[end] != '/') end++;
+        len = end - pos - 1;
+        if ((child = findStatic(node, seg, len, NULL)) != NULL)
+            search(s, child, end);
+        if (len > 0 && s->depth < MG_ROUTE_MAX_PARAMS)
+        {
+            s->caps[s->depth++] = mg_str_n(seg, len);
+            if (node->param != NULL) search(s, node->param, end);
+            if (node->optional != NULL) search(s, node->optional, end);
+            s->depth--;
+        }
+    }
+    if (node->optional != NULL && s->depth < MG_ROUTE_MAX_PARAMS)
+    {
+        s->caps[s->depth++] = mg_str_n(NULL, 0);
+        search(s, node->optional, pos);
+        s->depth--;
+    }
+}
+
+bool mgRouteTreeFind(mgRouteTree *t, struct mg_str method, struct mg_str path,
+    uint32_t from, mgRouteMatch *m)
+{
+    mgRouteSearch s;
+    for (size_t i = 0; i < t->numRoots; i++)
+    {
+        if (mg_vcmp(&method, t->roots[i].method) != 0) continue;
+        s.path = path.ptr;
+        s.len = path.len;
+        s.from = from;
+        s.found = false;
+        s.best = m;
+        s.depth = 0;
+        // Paths start with a slash, the root stands before it
+        if (path.len > 0 && path.ptr[0] == '/') search(&s, t->roots[i].root, 0);
+        return s.found;
+    }
+    return false;
+}
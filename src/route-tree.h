@@ -0,0 +1,56 @@
+#ifndef QJS_ROUTE_TREE_H
+#define QJS_ROUTE_TREE_H
+
+#include "mongoose.h"
+
+// Routes by method and path, with one tree of path segments per method.
+// Lookups walk the request path once and only visit the branches that can
+// match it, whatever the number of routes.
+//
+// Matching follows path-to-regexp with its default options: static
+// segments compare case-insensitively and a single trailing slash is
+// ignored.
+typedef struct mgRouteTree mgRouteTree;
+
+#define MG_ROUTE_MAX_PARAMS 32
+
+typedef enum {
+    MG_ROUTE_SEG_STATIC,        // "users"
+    MG_ROUTE_SEG_PARAM,         // ":id", one non-empty segment
+    MG_ROUTE_SEG_OPTIONAL,      // ":id?", one segment or none
+    MG_ROUTE_SEG_ONE_OR_MORE,   // ":path+", the remaining segments, last only
+    MG_ROUTE_SEG_ZERO_OR_MORE,  // ":path*", last only
+    MG_ROUTE_SEG_CATCH_ALL      // "(.*)", the rest of the path, last only
+} mgRouteSegKind;
+
+typedef struct {
+    mgRouteSegKind kind;
+    const char *text;   // Static segments, without slashes
+    size_t len;
+} mgRouteSeg;
+
+typedef struct {
+    void *data;
+    uint32_t order;
+    size_t numParams;
+    // One per parameter segment of the route, in order. Skipped optional
+    // parameters have a NULL ptr. Repeated ones hold the segments with the
+    // slashes between them.
+    struct mg_str params[MG_ROUTE_MAX_PARAMS];
+} mgRouteMatch;
+
+mgRouteTree *mgRouteTreeNew(void);
+void mgRouteTreeFree(mgRouteTree *t);
+
+// Adds the route "/seg[0]/seg[1]/...". When several routes match a path,
+// the one with the lowest order wins. Returns -1 when out of memory, or
+// when the segments are not valid: a repeated or catch-all parameter that
+// is not the last one, or more than MG_ROUTE_MAX_PARAMS parameters.
+int mgRouteTreeAdd(mgRouteTree *t, const char *method,
+    const mgRouteSeg *segs, size_t n, uint32_t order, void *data);
+
+// Finds the matching route with the lowest order not below from
+bool mgRouteTreeFind(mgRouteTree *t, struct mg_str method, struct mg_str path,
+    uint32_t from, mgRouteMatch *m);
+
+#endif
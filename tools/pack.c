@@ -0,0 +1,177 @@
+// Generates a C source implementing mg_unpack() and mg_unlist() for
+// mongoose's packed filesystem, see MG_ENABLE_PACKED_FS.
+//
+// Usage: pack [-z] OUTPUT.c ROOT PREFIX FILE...
+//
+// Every FILE must live under ROOT. It is stored as PREFIX followed by its
+// path relative to ROOT, e.g. ROOT=public PREFIX=/web turns
+// public/js/app.js into /web/js/app.js. With -z a gzipped copy is stored
+// next to every file it makes smaller, as "<name>.gz", which the HTTP
+// server sends to clients accepting gzip.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <zlib.h>
+
+struct entry {
+  char *name;
+  unsigned char *data;
+  size_t size;
+  time_t mtime;
+};
+
+static int cmp_entries(const void *a, const void *b) {
+  return strcmp(((const struct entry *) a)->name,
+                ((const struct entry *) b)->name);
+}
+
+static unsigned char *read_file(const char *path, size_t *size) {
+  FILE *fp = fopen(path, "rb");
+  unsigned char *data = NULL;
+  long len;
+  if (fp == NULL) return NULL;
+  if (fseek(fp, 0, SEEK_END) == 0 && (len = ftell(fp)) >= 0 &&
+      fseek(fp, 0, SEEK_SET) == 0 &&
+      (data = (unsigned char *) malloc((size_t) len + 1)) != NULL &&
+      fread(data, 1, (size_t) len, fp) != (size_t) len) {
+    free(data);
+    data = NULL;
+  }
+  if (data != NULL) *size = (size_t) len;
+  fclose(fp);
+  return data;
+}
+
+static unsigned char *gzip(const unsigned char *in, size_t len, size_t *out) {
+  z_stream z;
+  unsigned char *buf;
+  size_t cap;
+  memset(&z, 0, sizeof(z));
+  if (deflateInit2(&z, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 9,
+                   Z_DEFAULT_STRATEGY) != Z_OK)
+    return NULL;
+  cap = deflateBound(&z, (uLong) len) + 1;
+  if ((buf = (unsigned char *) malloc(cap)) != NULL) {
+    z.next_in = (Bytef *) in;
+    z.avail_in = (uInt) len;
+    z.next_out = buf;
+    z.avail_out = (uInt) cap;
+    if (deflate(&z, Z_FINISH) != Z_STREAM_END) {
+      free(buf);
+      buf = NULL;
+    }
+    *out = z.total_out;
+  }
+  deflateEnd(&z);
+  return buf;
+}
+
+static char *concat(const char *a, const char *b, const char *c) {
+  size_t n = strlen(a) + strlen(b) + strlen(c) + 1;
+  char *s = (char *) malloc(n);
+  if (s != NULL) snprintf(s, n, "%s%s%s", a, b, c);
+  return s;
+}
+
+int main(int argc, char *argv[]) {
+  struct entry *entries;
+  size_t i, j, n = 0, rootlen, prefixlen;
+  int compress = 0, first = 1;
+  const char *root, *prefix;
+  FILE *out;
+
+  if (argc > 1 && strcmp(argv[1], "-z") == 0) compress = 1, first = 2;
+  if (argc < first + 3) {
+    fprintf(stderr, "Usage: %s [-z] OUTPUT.c ROOT PREFIX FILE...\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  root = argv[first + 1];
+  prefix = argv[first + 2];
+  prefixlen = strlen(prefix);
+  rootlen = strlen(root);
+  while (rootlen > 0 && root[rootlen - 1] == '/') rootlen--;
+  entries = (struct entry *) calloc((size_t) argc * 2, sizeof(*entries));
+  if (entries == NULL) return EXIT_FAILURE;
+
+  for (i = (size_t) first + 3; i < (size_t) argc; i++) {
+    const char *path = argv[i], *rel = path;
+    struct stat st;
+    struct entry *e = &entries[n];
+    if (strncmp(path, root, rootlen) == 0 && path[rootlen] == '/') {
+      rel = path + rootlen + 1;
+    }
+    if (stat(path, &st) != 0 || (e->data = read_file(path, &e->size)) == NULL) {
+      fprintf(stderr, "%s: cannot read %s\n", argv[0], path);
+      return EXIT_FAILURE;
+    }
+    e->mtime = st.st_mtime;
+    e->name = concat(prefix, prefixlen > 0 && prefix[prefixlen - 1] == '/' ? "" : "/",
+                     rel);
+    n++;
+    if (compress) {
+      struct entry *z = &entries[n];
+      z->data = gzip(e->data, e->size, &z->size);
+      if (z->data != NULL && z->size < e->size) {
+        z->name = concat(e->name, ".gz", "");
+        z->mtime = e->mtime;
+        n++;
+      } else {
+        free(z->data);
+        z->data = NULL;
+      }
+    }
+  }
+  // packed_list() expects the names to be sorted
+  qsort(entries, n, sizeof(*entries), cmp_entries);
+
+  if ((out = fopen(argv[first], "w")) == NULL) {
+    fprintf(stderr, "%s: cannot write %s\n", argv[0], argv[first]);
+    return EXIT_FAILURE;
+  }
+  fprintf(out, "// Generated by tools/pack.c, do not edit\n");
+  fprintf(out, "#include <stddef.h>\n#include <string.h>\n#include <time.h>\n\n");
+  for (i = 0; i < n; i++) {
+    fprintf(out, "static const unsigned char v%lu[] = {", (unsigned long) i);
+    for (j = 0; j < entries[i].size; j++) {
+      fprintf(out, "%s%d,", j % 16 == 0 ? "\n  " : "", entries[i].data[j]);
+    }
+    fprintf(out, "\n  0  // trailing zero\n};\n\n");
+  }
+  fprintf(out, "static const struct packed_file {\n");
+  fprintf(out, "  const char *name;\n  const unsigned char *data;\n");
+  fprintf(out, "  size_t size;\n  time_t mtime;\n} packed_files[] = {\n");
+  for (i = 0; i < n; i++) {
+    const char *p;
+    fputs("  {\"", out);
+    for (p = entries[i].name; *p != '\0'; p++) {
+      if (*p == '"' || *p == '\\') fputc('\\', out);
+      fputc(*p, out);
+    }
+    fprintf(out, "\", v%lu, sizeof(v%lu) - 1, %lu},\n", (unsigned long) i,
+            (unsigned long) i, (unsigned long) entries[i].mtime);
+  }
+  fprintf(out, "  {NULL, NULL, 0, 0}\n};\n\n");
+  fprintf(out,
+          "const char *mg_unlist(size_t no);\n"
+          "const char *mg_unlist(size_t no) {\n"
+          "  return packed_files[no].name;\n"
+          "}\n\n"
+          "const char *mg_unpack(const char *name, size_t *size, "
+          "time_t *mtime);\n"
+          "const char *mg_unpack(const char *name, size_t *size, "
+          "time_t *mtime) {\n"
+          "  const struct packed_file *p;\n"
+          "  for (p = packed_files; p->name != NULL; p++) {\n"
+          "    if (strcmp(p->name, name) != 0) continue;\n"
+          "    if (size != NULL) *size = p->size;\n"
+          "    if (mtime != NULL) *mtime = p->mtime;\n"
+          "    return (const char *) p->data;\n"
+          "  }\n"
+          "  return NULL;\n"
+          "}\n");
+  fclose(out);
+  return EXIT_SUCCESS;
+}